@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/* Fixed-size array of buckets that can be resized without holding the old
+ * and the new storage at once. Trivially copyable buckets are resized with
+ * std::realloc, which extends the block where possible and moves large
+ * blocks by remapping their pages instead of copying them; other bucket
+ * types fall back to allocate, move and free. */
+template < typename T >
+class bucket_array {
+public:
+	using iterator = T*;
+	using const_iterator = const T*;
+
+	bucket_array() = default;
+
+	explicit bucket_array(std::size_t n) {
+		resize(n);
+	}
+
+	bucket_array(const bucket_array& a) {
+		_p = _allocate(a._n);
+		std::uninitialized_copy(a.begin(), a.end(), _p);
+		_n = a._n;
+	}
+
+	bucket_array(bucket_array&& a) noexcept {
+		std::swap(_p, a._p);
+		std::swap(_n, a._n);
+	}
+
+	bucket_array& operator=(bucket_array a) noexcept {
+		std::swap(_p, a._p);
+		std::swap(_n, a._n);
+		return *this;
+	}
+
+	~bucket_array() {
+		std::destroy(begin(), end());
+		std::free(_p);
+	}
+
+	/* value-initializes the buckets past the old size */
+	void resize(std::size_t n) {
+		if (n == _n) {
+			_resize_bytes = n * sizeof(T);
+			return;
+		}
+		if (n < _n)
+			std::destroy(_p + n, _p + _n);
+		/* both blocks are live at once unless realloc kept the old one */
+		_resize_bytes = (_n + n) * sizeof(T);
+		if constexpr (std::is_trivially_copyable< T >::value) {
+			T* p = static_cast< T* >(std::realloc(_p, std::max< std::size_t >(n, 1) * sizeof(T)));
+			if (!p)
+				throw std::bad_alloc();
+			if (p == _p)
+				_resize_bytes = std::max(_n, n) * sizeof(T);
+			_p = p;
+		} else {
+			T* p = _allocate(n);
+			for (std::size_t i = 0; i < std::min(n, _n); ++i) {
+				new (p + i) T(std::move(_p[i]));
+				_p[i].~T();
+			}
+			std::free(_p);
+			_p = p;
+		}
+		for (std::size_t i = _n; i < n; ++i)
+			new (_p + i) T();
+		_n = n;
+	}
+
+	/* bytes the allocator held during the last resize: the larger of the
+	 * two sizes if realloc resized the block in place, both of them
+	 * otherwise. A block moved by remapping pages counts as both too, since
+	 * that cannot be told apart from a copy. */
+	std::size_t last_resize_bytes() const noexcept {
+		return _resize_bytes;
+	}
+
+	std::size_t size() const noexcept {
+		return _n;
+	}
+
+	T& operator[](std::size_t i) noexcept {
+		return _p[i];
+	}
+
+	const T& operator[](std::size_t i) const noexcept {
+		return _p[i];
+	}
+
+	iterator begin() noexcept {
+		return _p;
+	}
+
+	const_iterator begin() const noexcept {
+		return _p;
+	}
+
+	iterator end() noexcept {
+		return _p + _n;
+	}
+
+	const_iterator end() const noexcept {
+		return _p + _n;
+	}
+
+private:
+	static T* _allocate(std::size_t n) {
+		T* p = static_cast< T* >(std::malloc(std::max< std::size_t >(n, 1) * sizeof(T)));
+		if (!p)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	T* _p = nullptr;
+	std::size_t _n = 0;
+	std::size_t _resize_bytes = 0;
+};
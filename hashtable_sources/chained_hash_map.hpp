@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <list>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "index_policy.hpp"
+
+/* Map counterpart of chained_hash_table: every node of a bucket's list holds
+ * a key together with its value. */
+template < typename Key, typename T, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index >
+class chained_hash_map {
+public:
+	using value_type = std::pair< const Key, T >;
+
+private:
+	using list = std::list< value_type >;
+	using vector = std::vector< list >;
+
+	template < typename Base1, typename Base2, typename V >
+	struct _iterator {
+	protected:
+		Base1 _s{}, _e{};
+		Base2 _c;
+
+	public:
+		_iterator() = default;
+		_iterator(Base1 s, Base1 e)
+				: _s(s), _e(e) {
+			while (_s != _e && _s->empty())
+				++_s;
+			if (_s != _e)
+				_c = _s->begin();
+		}
+
+		_iterator(Base1 s, Base1 e, Base2 c)
+				: _s(s), _e(e), _c(c) {}
+
+		/* iterator to const_iterator */
+		template < typename B1, typename B2, typename W >
+		_iterator(const _iterator< B1, B2, W >& i)
+				: _s(i._s), _e(i._e), _c(i._c) {}
+
+		explicit operator Base1() {
+			return _s;
+		}
+
+		explicit operator Base2() {
+			return _c;
+		}
+
+		V& operator*() const noexcept {
+			return *_c;
+		}
+
+		V* operator->() const noexcept {
+			return std::addressof(*_c);
+		}
+
+		_iterator& operator++() noexcept {
+			if (++_c == _s->end()) {
+				do {
+					++_s;
+				} while (_s != _e && _s->empty());
+				_c = _s != _e ? _s->begin() : Base2();
+			}
+			return *this;
+		}
+
+		_iterator operator++(int) {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _s == i._s && _e == i._e && _c == i._c;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+
+		template < typename, typename, typename >
+		friend struct _iterator;
+	};
+public:
+	using iterator = _iterator< typename vector::iterator, typename list::iterator, value_type >;
+	using const_iterator = _iterator< typename vector::const_iterator, typename list::const_iterator, const value_type >;
+
+	chained_hash_map()
+			: _ml_factor(10),
+			  _data(Index().round(1)) {
+		_index.reset(size());
+	}
+
+	/* splices every node into its new bucket, see chained_hash_table */
+	void rehash(std::size_t count) {
+		count = _index.round(count);
+		std::size_t old = size();
+		_index.reset(count);
+		if (count > old)
+			_data.resize(count);
+		for (std::size_t b = 0; b < old; ++b) {
+			for (auto it = _data[b].begin(); it != _data[b].end();) {
+				auto cur = it++;
+				std::size_t to = _index(Hash()(cur->first));
+				if (to != b)
+					_data[to].splice(_data[to].end(), _data[b], cur);
+			}
+		}
+		if (count < old) {
+			_data.resize(count);
+			_data.shrink_to_fit();
+		}
+	}
+
+	const_iterator find(const Key& k) const {
+		auto lit = _data.begin() + _index(Hash()(k));
+		for (auto it = lit->begin(); it != lit->end(); ++it) {
+			if (KeyEqual()(it->first, k))
+				return const_iterator(lit, _data.end(), it);
+		}
+		return end();
+	}
+
+	iterator find(const Key& k) {
+		auto lit = _data.begin() + _index(Hash()(k));
+		for (auto it = lit->begin(); it != lit->end(); ++it) {
+			if (KeyEqual()(it->first, k))
+				return iterator(lit, _data.end(), it);
+		}
+		return end();
+	}
+
+	/* constructs the value from args only if k is not present yet */
+	template < typename... Args >
+	std::pair< iterator, bool > try_emplace(const Key& k, Args&&... args) {
+		return _try_emplace(k, std::forward< Args >(args)...);
+	}
+
+	template < typename... Args >
+	std::pair< iterator, bool > try_emplace(Key&& k, Args&&... args) {
+		return _try_emplace(std::move(k), std::forward< Args >(args)...);
+	}
+
+	template < typename M >
+	std::pair< iterator, bool > insert_or_assign(const Key& k, M&& m) {
+		auto r = try_emplace(k, std::forward< M >(m));
+		if (!r.second)
+			r.first->second = std::forward< M >(m);
+		return r;
+	}
+
+	template < typename M >
+	std::pair< iterator, bool > insert_or_assign(Key&& k, M&& m) {
+		auto r = try_emplace(std::move(k), std::forward< M >(m));
+		if (!r.second)
+			r.first->second = std::forward< M >(m);
+		return r;
+	}
+
+	T& operator[](const Key& k) {
+		return try_emplace(k).first->second;
+	}
+
+	T& operator[](Key&& k) {
+		return try_emplace(std::move(k)).first->second;
+	}
+
+	bool erase(const Key& k) noexcept {
+		if (auto it = find(k); it != end()) {
+			static_cast< typename vector::iterator >(it)->erase(static_cast< typename list::iterator >(it));
+			--_entries;
+			return true;
+		}
+		return false;
+	}
+
+	std::size_t size() const noexcept {
+		return _data.size();
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / size();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	iterator begin() {
+		return iterator(_data.begin(), _data.end());
+	}
+
+	const_iterator begin() const {
+		return const_iterator(_data.begin(), _data.end());
+	}
+
+	iterator end() {
+		return iterator(_data.end(), _data.end());
+	}
+
+	const_iterator end() const {
+		return const_iterator(_data.end(), _data.end());
+	}
+
+private:
+	template < typename _K, typename... Args >
+	std::pair< iterator, bool > _try_emplace(_K&& k, Args&&... args) {
+		if (auto it = find(k); it != end())
+			return { it, false };
+		auto lit = _data.begin() + _index(Hash()(k));
+		lit->emplace_back(std::piecewise_construct, std::forward_as_tuple(std::forward< _K >(k)),
+				std::forward_as_tuple(std::forward< Args >(args)...));
+		++_entries;
+		auto node = std::prev(lit->end());
+		/* nodes survive a rehash, only the bucket has to be looked up again */
+		if (load_factor() > _ml_factor) {
+			rehash(2 * size());
+			lit = _data.begin() + _index(Hash()(node->first));
+		}
+		return { iterator(lit, _data.end(), node), true };
+	}
+
+	float _ml_factor;
+	vector _data;
+	Index _index;
+	std::size_t _entries = 0;
+};
@@ -1,23 +1,56 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <functional>
+#include <iterator>
 #include <list>
+#include <memory>
+#include <optional>
+#include <type_traits>
 #include <vector>
 
+#include "index_policy.hpp"
+#include "rehash_report.hpp"
+#include "stored_hash.hpp"
 
-template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key > >
+/* With StoreHash every node also keeps the hash of its key, see
+ * stored_hash. With Inline > 0 the first Inline keys are kept packed inside
+ * the table object and found by a plain scan; no bucket array or node is
+ * allocated until one more key arrives or rehash()/reserve() asks for
+ * buckets. Moving such a table invalidates its iterators. */
+template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index, bool StoreHash = false, std::size_t Inline = 0 >
 class chained_hash_table {
-	using list = std::list < Key >;
+	struct entry : stored_hash< StoreHash > {
+		template < typename K >
+		entry(K&& k, std::size_t h)
+				: key(std::forward< K >(k)) {
+			this->store(h);
+		}
+
+		Key key;
+	};
+
+	using list = std::list < entry >;
 	using vector = std::vector< list >;
+	using slot = std::optional< entry >;
 	
 	template < typename Base1, typename Base2, typename T >
 	struct _iterator {
 	protected:
-		Base1 _s = nullptr, _e = nullptr;
+		Base1 _s{}, _e{};
 		Base2 _c;
+		/* set while walking the inline keys */
+		const slot* _i = nullptr;
 
 	public:
 		_iterator() = default;
+		explicit _iterator(const slot* i)
+				: _i(i) {}
+
 		_iterator(Base1 s, Base1 e)
 				: _s(s), _e(e) {
 			while (_s != _e && _s->empty())
@@ -38,18 +71,23 @@ class chained_hash_table {
 		}
 
 		T& operator*() const noexcept {
-			return *_c;
+			return _i ? (*_i)->key : _c->key;
 		}
 
 		T* operator->() const noexcept {
-			return std::addressof(*_c);
+			return std::addressof(**this);
 		}
 
 		_iterator& operator++() noexcept {
+			if (_i) {
+				++_i;
+				return *this;
+			}
 			if (++_c == _s->end()) {
 				do {
 					++_s;
 				} while (_s != _e && _s->empty());
+				_c = _s != _e ? _s->begin() : Base2();
 			}
 			return *this;
 		}
@@ -61,7 +99,7 @@ class chained_hash_table {
 		}
 
 		bool operator==(const _iterator& i) const noexcept {
-			return _s == i._s && _e == i._e && _c == i._c;
+			return _s == i._s && _e == i._e && _c == i._c && _i == i._i;
 		}
 
 		bool operator!=(const _iterator& i) const noexcept {
@@ -74,44 +112,114 @@ public:
 
 	chained_hash_table()
 			: _ml_factor(10),
-			  _data(1) {}
+			  _data(Inline ? 0 : Index().round(1)) {
+		_index.reset(Index().round(1));
+	}
 
-	void rehash(std::size_t count) {
-		auto tmp = std::move(_data);
-		_data.resize(count);
-		auto olen = _entries;
-		_entries = 0;
-		for (auto& l : tmp) {
-			if (olen == _entries)
-				break;
-			for (auto& k : l) {
-				_data[Hash()(k) % size()].push_back(std::move(k));
-				++_entries;
+	/* sized once for all the keys in [first, last) when that can be counted */
+	template < typename It >
+	chained_hash_table(It first, It last)
+			: chained_hash_table() {
+		using category = typename std::iterator_traits< It >::iterator_category;
+		if constexpr (std::is_base_of< std::forward_iterator_tag, category >::value)
+			reserve(std::distance(first, last));
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	/* Resizes the bucket array and splices every node into its new bucket;
+	 * nodes are relinked, never copied or reallocated, so only the array of
+	 * list heads is ever held twice. */
+	rehash_report rehash(std::size_t count) {
+		if (_is_small())
+			return _promote(count);
+		auto start = std::chrono::steady_clock::now();
+		count = _index.round(count);
+		std::size_t old = size(), old_capacity = _data.capacity();
+		_index.reset(count);
+		if (count > old)
+			_data.resize(count);
+		for (std::size_t b = 0; b < old; ++b) {
+			for (auto it = _data[b].begin(); it != _data[b].end();) {
+				auto cur = it++;
+				std::size_t to = _index(cur->template hash< Hash >(cur->key));
+				if (to != b)
+					_data[to].splice(_data[to].end(), _data[b], cur);
 			}
 		}
+		if (count < old) {
+			_data.resize(count);
+			_data.shrink_to_fit();
+		}
+		std::size_t peak = std::max(old_capacity, _data.capacity());
+		if (_data.capacity() != old_capacity)
+			peak = old_capacity + _data.capacity();
+		return { peak * sizeof(list), std::chrono::steady_clock::now() - start };
+	}
+
+	/* the fewest buckets that keep the load factor under the maximum */
+	rehash_report compact() {
+		if (_is_small())
+			return {};
+		return rehash(std::ceil(_entries / _ml_factor));
+	}
+
+	/* makes room for n keys without a rehash on the way */
+	void reserve(std::size_t n) {
+		if (_is_small() && n <= Inline)
+			return;
+		std::size_t count = std::ceil(n / _ml_factor);
+		if (_is_small() || count > size())
+			rehash(count);
 	}
 
 	const_iterator find(const Key& k) const {
-		auto lit = _data.begin() + Hash()(k) % size();
-		for (auto it = lit->begin(); it != lit->end(); ++it) {
-			if (KeyEqual()(*it, k))
-				return const_iterator(lit, _data.end(), it);
-		}
-		return end();
+		return find(k, _hash(k));
 	}
 
 	iterator find(const Key& k) {
-		auto lit = _data.begin() + Hash()(k) % size();
+		return find(k, _hash(k));
+	}
+
+	/* lookup and insert for callers that already have hash == Hash()(k) */
+	const_iterator find(const Key& k, std::size_t hash) const {
+		return _find(k, hash, _index(hash));
+	}
+
+	iterator find(const Key& k, std::size_t hash) {
+		if (_is_small()) {
+			std::size_t i = _find_small(k, hash);
+			return iterator(_small.data() + i);
+		}
+		auto lit = _data.begin() + _index(hash);
 		for (auto it = lit->begin(); it != lit->end(); ++it) {
-			if (KeyEqual()(*it, k))
+			if (it->may_equal(hash) && KeyEqual()(it->key, k))
 				return iterator(lit, _data.end(), it);
 		}
 		return end();
 	}
 
-	bool erase(const Key& k) noexcept {
+	bool insert(const Key& k, std::size_t hash) {
+		return _insert(k, hash, _index(hash));
+	}
+
+	bool insert(Key&& k, std::size_t hash) {
+		return _insert(std::move(k), hash, _index(hash));
+	}
+
+	bool erase(const Key& k) {
+		if (_is_small()) {
+			std::size_t i = _find_small(k, _hash(k));
+			if (i == _entries)
+				return false;
+			/* the last inline key fills the hole */
+			std::swap(_small[i], _small[_entries - 1]);
+			_small[--_entries].reset();
+			return true;
+		}
 		if (auto it = find(k); it != end()) {
 			static_cast< typename vector::iterator >(it)->erase(static_cast< typename list::iterator >(it));
+			--_entries;
 			return true;
 		}
 		return false;
@@ -125,12 +233,41 @@ public:
 		return _insert(std::move(k));
 	}
 
+	/* Batched versions of find, find(k) != end() and insert over keys[0, n).
+	 * A batch of keys is hashed first and all their buckets, then all their
+	 * first nodes, are prefetched before any probe runs, so the cache misses
+	 * of independent keys overlap instead of being waited for one by one. */
+	void find_many(const Key* keys, std::size_t n, const_iterator* out) const {
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			out[i] = _find(keys[i], h, b);
+		});
+	}
+
+	void contains_many(const Key* keys, std::size_t n, bool* out) const {
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			out[i] = _find(keys[i], h, b) != end();
+		});
+	}
+
+	/* returns the number of keys that were not present yet */
+	std::size_t insert_many(const Key* keys, std::size_t n) {
+		reserve(_entries + n);
+		std::size_t inserted = 0, count = size();
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			/* rounding may still let one insert grow the table */
+			if (size() != count)
+				b = _index(h);
+			inserted += _insert(keys[i], h, b);
+		});
+		return inserted;
+	}
+
 	std::size_t size() const noexcept {
-		return _data.size();
+		return _is_small() ? Inline : _data.size();
 	}
 
 	float load_factor() const noexcept {
-		return _entries / size();
+		return float(_entries) / size();
 	}
 
 	void max_load_factor(float ml) noexcept {
@@ -138,30 +275,126 @@ public:
 	}
 
 	iterator begin() {
+		if (_is_small())
+			return iterator(_small.data());
 		return iterator(_data.begin(), _data.end());
 	}
 
 	const_iterator begin() const {
+		if (_is_small())
+			return const_iterator(_small.data());
 		return const_iterator(_data.begin(), _data.end());
 	}
 
 	iterator end() {
-		return iterator(_data.begin(), _data.end());
+		if (_is_small())
+			return iterator(_small.data() + _entries);
+		return iterator(_data.end(), _data.end());
 	}
 
 	const_iterator end() const {
-		return const_iterator(_data.begin(), _data.end());
+		if (_is_small())
+			return const_iterator(_small.data() + _entries);
+		return const_iterator(_data.end(), _data.end());
 	}
 
 private:
+	static constexpr std::size_t _batch = 16;
+
+	bool _is_small() const noexcept {
+		return Inline && _data.empty();
+	}
+
+	/* moves the inline keys into a bucket array of at least `count` buckets */
+	rehash_report _promote(std::size_t count) {
+		auto start = std::chrono::steady_clock::now();
+		count = _index.round(count);
+		_index.reset(count);
+		_data.resize(count);
+		for (std::size_t i = 0; i < _entries; ++i) {
+			entry& e = *_small[i];
+			std::size_t h = e.template hash< Hash >(e.key);
+			_data[_index(h)].emplace_back(std::move(e.key), h);
+			_small[i].reset();
+		}
+		return { _data.capacity() * sizeof(list), std::chrono::steady_clock::now() - start };
+	}
+
+	/* Hash()(k), except in small mode without stored hashes: the inline
+	 * scan then compares keys only and the hash would be thrown away */
+	std::size_t _hash(const Key& k) const {
+		return _is_small() && !StoreHash ? 0 : Hash()(k);
+	}
+
+	/* position of k among the inline keys, _entries if it is not there */
+	std::size_t _find_small(const Key& k, std::size_t h) const {
+		std::size_t i = 0;
+		while (i < _entries && !(_small[i]->may_equal(h) && KeyEqual()(_small[i]->key, k)))
+			++i;
+		return i;
+	}
+
+	template < typename F >
+	void _batched(const Key* keys, std::size_t n, F&& f) const {
+		if (_is_small()) {
+			for (std::size_t i = 0; i < n; ++i)
+				f(i, _hash(keys[i]), 0);
+			return;
+		}
+		std::size_t hash[_batch], pos[_batch];
+		for (std::size_t s = 0; s < n; s += _batch) {
+			std::size_t m = std::min(_batch, n - s);
+			for (std::size_t i = 0; i < m; ++i) {
+				hash[i] = Hash()(keys[s + i]);
+				pos[i] = _index(hash[i]);
+				__builtin_prefetch(&_data[pos[i]]);
+			}
+			for (std::size_t i = 0; i < m; ++i) {
+				if (!_data[pos[i]].empty())
+					__builtin_prefetch(std::addressof(_data[pos[i]].front()));
+			}
+			for (std::size_t i = 0; i < m; ++i)
+				f(s + i, hash[i], pos[i]);
+		}
+	}
+
+	const_iterator _find(const Key& k, std::size_t h, std::size_t b) const {
+		if (_is_small())
+			return const_iterator(_small.data() + _find_small(k, h));
+		auto lit = _data.begin() + b;
+		for (auto it = lit->begin(); it != lit->end(); ++it) {
+			if (it->may_equal(h) && KeyEqual()(it->key, k))
+				return const_iterator(lit, _data.end(), it);
+		}
+		return end();
+	}
+
 	template < typename _K >
 	bool _insert(_K&& k) {
-		std::size_t pos = Hash()(k) % size();
+		std::size_t h = _hash(k);
+		return _insert(std::forward< _K >(k), h, _index(h));
+	}
+
+	template < typename _K >
+	bool _insert(_K&& k, std::size_t h, std::size_t pos) {
+		if (_is_small()) {
+			if (_find_small(k, h) != _entries)
+				return false;
+			if (_entries < Inline) {
+				_small[_entries++].emplace(std::forward< _K >(k), h);
+				return true;
+			}
+			reserve(Inline + 1);
+			/* the inline scan may have been handed no hash, see _hash */
+			if (!StoreHash)
+				h = Hash()(k);
+			pos = _index(h);
+		}
 		for (const auto& b : _data[pos]) {
-			if (KeyEqual()(k, b))
+			if (b.may_equal(h) && KeyEqual()(k, b.key))
 				return false;
 		}
-		_data[pos].push_back(std::forward< _K >(k));
+		_data[pos].emplace_back(std::forward< _K >(k), h);
 		++_entries;
 		if (load_factor() > _ml_factor)
 			rehash(2 * size());
@@ -170,6 +403,8 @@ private:
 
 	float _ml_factor;
 	vector _data;
+	Index _index;
 	std::size_t _entries = 0;
+	std::array< slot, Inline > _small;
 };
 
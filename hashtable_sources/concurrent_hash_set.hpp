@@ -0,0 +1,275 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "epoch.hpp"
+
+/* Lock-free set after Shalev and Shavit's split-ordered lists. All keys live
+ * in one Harris-Michael linked list sorted by their bit-reversed hash, so the
+ * keys of bucket b form a contiguous run that starts at a dummy node for b.
+ * Growing the table only doubles the bucket count: a new bucket is hooked in
+ * lazily by inserting its dummy into the run of its parent bucket, and no
+ * key is ever moved. Erase marks the next pointer of a node and unlinks it,
+ * unlinked nodes are reclaimed through epoch_domain. Dummies are never
+ * removed. Bucket pointers live in segments of growing size that are
+ * allocated on first use and never reallocated. */
+template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key > >
+class concurrent_hash_set {
+	struct node {
+		explicit node(std::uint64_t so)
+				: so_key(so) {}
+
+		/* lowest bit marks the node as erased */
+		std::atomic< std::uintptr_t > next{ 0 };
+		const std::uint64_t so_key;
+
+		bool dummy() const noexcept {
+			return !(so_key & 1);
+		}
+	};
+
+	struct key_node : node {
+		template < typename K >
+		key_node(std::uint64_t so, K&& k)
+				: node(so), key(std::forward< K >(k)) {}
+
+		const Key key;
+	};
+
+	using bucket = std::atomic< node* >;
+
+	static constexpr unsigned _segments = 48;
+
+public:
+	/* average keys per bucket before the bucket count doubles */
+	static constexpr std::size_t max_load = 2;
+
+	concurrent_hash_set() {
+		_segment(0)[0].store(new node(0));
+	}
+
+	concurrent_hash_set(const concurrent_hash_set&) = delete;
+	concurrent_hash_set& operator=(const concurrent_hash_set&) = delete;
+
+	~concurrent_hash_set() {
+		/* every node that is still linked, erased or not, is owned here;
+		 * unlinked ones have been handed to the epoch domain */
+		node* n = _table[0].load()[0].load();
+		while (n) {
+			node* next = _ptr(n->next.load());
+			_delete(n);
+			n = next;
+		}
+		for (auto& s : _table)
+			delete[] s.load();
+	}
+
+	bool insert(const Key& k) {
+		return _insert(k);
+	}
+
+	bool insert(Key&& k) {
+		return _insert(std::move(k));
+	}
+
+	bool contains(const Key& k) const {
+		epoch_domain::guard g;
+		std::size_t h = Hash()(k);
+		const node* n = _bucket(h & (_size.load() - 1));
+		std::uint64_t so = _regular(h);
+		/* a plain walk that skips erased nodes; unlinking is left to writers */
+		for (n = _ptr(n->next.load(std::memory_order_acquire)); n; n = _ptr(n->next.load(std::memory_order_acquire))) {
+			if (n->so_key > so)
+				return false;
+			if (n->so_key == so && KeyEqual()(static_cast< const key_node* >(n)->key, k))
+				return !_marked(n->next.load(std::memory_order_acquire));
+		}
+		return false;
+	}
+
+	bool erase(const Key& k) {
+		epoch_domain::guard g;
+		std::size_t h = Hash()(k);
+		node* head = _bucket(h & (_size.load() - 1));
+		std::uint64_t so = _regular(h);
+		while (true) {
+			window w;
+			if (!_find(head, so, &k, w))
+				return false;
+			std::uintptr_t next = w.cur->next.load();
+			if (_marked(next))
+				continue;
+			if (!w.cur->next.compare_exchange_strong(next, next | 1))
+				continue;
+			std::uintptr_t cur = std::uintptr_t(w.cur);
+			if (w.prev->compare_exchange_strong(cur, next))
+				epoch_domain::instance().retire(static_cast< key_node* >(w.cur));
+			else
+				_find(head, so, &k, w);
+			_count.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	/* approximate while other threads are writing */
+	std::size_t size() const noexcept {
+		return _count.load(std::memory_order_relaxed);
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _size.load(std::memory_order_relaxed);
+	}
+
+	float load_factor() const noexcept {
+		return float(size()) / bucket_count();
+	}
+
+private:
+	/* prev points at the link to cur, cur is the first node not ordered
+	 * before the searched one */
+	struct window {
+		std::atomic< std::uintptr_t >* prev;
+		node* cur;
+	};
+
+	static node* _ptr(std::uintptr_t p) noexcept {
+		return reinterpret_cast< node* >(p & ~std::uintptr_t(1));
+	}
+
+	static bool _marked(std::uintptr_t p) noexcept {
+		return p & 1;
+	}
+
+	static std::uint64_t _reverse(std::uint64_t x) noexcept {
+		x = (x >> 1 & 0x5555555555555555ull) | (x & 0x5555555555555555ull) << 1;
+		x = (x >> 2 & 0x3333333333333333ull) | (x & 0x3333333333333333ull) << 2;
+		x = (x >> 4 & 0x0F0F0F0F0F0F0F0Full) | (x & 0x0F0F0F0F0F0F0F0Full) << 4;
+		x = (x >> 8 & 0x00FF00FF00FF00FFull) | (x & 0x00FF00FF00FF00FFull) << 8;
+		x = (x >> 16 & 0x0000FFFF0000FFFFull) | (x & 0x0000FFFF0000FFFFull) << 16;
+		return x >> 32 | x << 32;
+	}
+
+	/* keys sort after the dummy of their bucket thanks to the set low bit */
+	static std::uint64_t _regular(std::uint64_t h) noexcept {
+		return _reverse(h | 1ull << 63);
+	}
+
+	static std::uint64_t _dummy(std::uint64_t b) noexcept {
+		return _reverse(b);
+	}
+
+	static void _delete(node* n) noexcept {
+		if (n->dummy())
+			delete n;
+		else
+			delete static_cast< key_node* >(n);
+	}
+
+	/* segment 0 holds buckets 0 and 1, segment s > 0 buckets [2^s, 2^(s+1)) */
+	static unsigned _segment_of(std::size_t b) noexcept {
+		unsigned s = 0;
+		while (b >> (s + 1))
+			++s;
+		return s;
+	}
+
+	bucket* _segment(unsigned s) const {
+		bucket* seg = _table[s].load(std::memory_order_acquire);
+		if (seg)
+			return seg;
+		bucket* fresh = new bucket[s ? std::size_t(1) << s : 2]();
+		if (_table[s].compare_exchange_strong(seg, fresh))
+			return fresh;
+		delete[] fresh;
+		return seg;
+	}
+
+	bucket& _slot(std::size_t b) const {
+		unsigned s = _segment_of(b);
+		return _segment(s)[s ? b - (std::size_t(1) << s) : b];
+	}
+
+	/* dummy node of bucket b, hooking it into the list first if needed */
+	node* _bucket(std::size_t b) const {
+		bucket& slot = _slot(b);
+		if (node* d = slot.load(std::memory_order_acquire))
+			return d;
+		/* the parent bucket's run is the one that splits */
+		node* parent = _bucket(b & ~(std::size_t(1) << _segment_of(b)));
+		node* d = new node(_dummy(b));
+		window w;
+		while (true) {
+			if (_find(parent, d->so_key, nullptr, w)) {
+				delete d;
+				d = w.cur;
+				break;
+			}
+			d->next.store(std::uintptr_t(w.cur), std::memory_order_relaxed);
+			std::uintptr_t cur = std::uintptr_t(w.cur);
+			if (w.prev->compare_exchange_strong(cur, std::uintptr_t(d)))
+				break;
+		}
+		node* expected = nullptr;
+		slot.compare_exchange_strong(expected, d);
+		return d;
+	}
+
+	/* Harris-Michael search from `head` for so_key and, for keys, k; erased
+	 * nodes met on the way are unlinked and retired */
+	static bool _find(node* head, std::uint64_t so, const Key* k, window& w) {
+	retry:
+		w.prev = &head->next;
+		w.cur = _ptr(w.prev->load());
+		while (w.cur) {
+			std::uintptr_t next = w.cur->next.load();
+			if (_marked(next)) {
+				std::uintptr_t cur = std::uintptr_t(w.cur);
+				if (!w.prev->compare_exchange_strong(cur, next & ~std::uintptr_t(1)))
+					goto retry;
+				epoch_domain::instance().retire(static_cast< key_node* >(w.cur));
+				w.cur = _ptr(next);
+				continue;
+			}
+			if (w.prev->load() != std::uintptr_t(w.cur))
+				goto retry;
+			if (w.cur->so_key > so)
+				return false;
+			if (w.cur->so_key == so && (!k || KeyEqual()(static_cast< key_node* >(w.cur)->key, *k)))
+				return true;
+			w.prev = &w.cur->next;
+			w.cur = _ptr(next);
+		}
+		return false;
+	}
+
+	template < typename K >
+	bool _insert(K&& k) {
+		epoch_domain::guard g;
+		std::size_t h = Hash()(k);
+		std::size_t size = _size.load();
+		node* head = _bucket(h & (size - 1));
+		key_node* n = new key_node(_regular(h), std::forward< K >(k));
+		window w;
+		while (true) {
+			if (_find(head, n->so_key, &n->key, w)) {
+				delete n;
+				return false;
+			}
+			n->next.store(std::uintptr_t(w.cur), std::memory_order_relaxed);
+			std::uintptr_t cur = std::uintptr_t(w.cur);
+			if (w.prev->compare_exchange_strong(cur, std::uintptr_t(static_cast< node* >(n))))
+				break;
+		}
+		std::size_t count = _count.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (count > max_load * size && size < std::size_t(1) << (_segments - 1))
+			_size.compare_exchange_strong(size, 2 * size);
+		return true;
+	}
+
+	mutable std::atomic< bucket* > _table[_segments] = {};
+	std::atomic< std::size_t > _size{ 2 };
+	std::atomic< std::size_t > _count{ 0 };
+};
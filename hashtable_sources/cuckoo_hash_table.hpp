@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "group_probing_hash_table.hpp"
+
+namespace cuckoo {
+
+/* alignment of a bucket of `slots` tags and keys: the bucket size rounded up
+ * to a power of two, so that a bucket of up to 64 bytes never straddles a
+ * cache line */
+constexpr std::size_t bucket_align(std::size_t slots, std::size_t size, std::size_t align) noexcept {
+	std::size_t bytes = (slots + align - 1) / align * align + slots * size;
+	std::size_t a = 1;
+	while (a < bytes && a < 64)
+		a *= 2;
+	return a < align ? align : a;
+}
+
+} // namespace cuckoo
+
+/* Bucketized cuckoo hashing: every key lives in one of `Slots` slots of one
+ * of two buckets, so a lookup reads two buckets (two cache lines for small
+ * keys, both requested up front) and nothing else while the stash is empty.
+ * The first bucket comes from the low bits of the hash; the second one is
+ * the first xor-ed with a hash of the key's 8-bit tag, so a key's other
+ * bucket is known from its tag alone and a full bucket can be searched for
+ * eviction paths without touching its keys. The tags also filter slots
+ * before KeyEqual is called, 0 marks a free slot.
+ *
+ * When both buckets of a new key are full, a breadth-first search looks for
+ * the shortest chain of keys that can each move to their other bucket and
+ * ends at a free slot. If there is none within the search bound, the key
+ * goes to a small stash; the table doubles when the stash overflows. */
+template < typename Key,
+		typename Hash = std::hash< Key >,
+		typename KeyEqual = std::equal_to< Key >,
+		std::size_t Slots = 4 >
+class cuckoo_hash_table {
+	static_assert(Slots > 0 && Slots <= 64, "a bucket has between 1 and 64 slots");
+
+	/* at most `max_depth` keys move for one insert, after at most
+	 * `max_nodes` buckets have been searched */
+	static constexpr std::size_t max_depth = 5;
+	static constexpr std::size_t max_nodes = 256;
+	static constexpr std::size_t stash_size = 8;
+
+	union slot {
+		slot() {}
+		~slot() {}
+		Key key;
+	};
+
+	struct alignas(cuckoo::bucket_align(Slots, sizeof(Key), alignof(Key))) bucket {
+		std::uint8_t tags[Slots] = {};
+		slot slots[Slots];
+	};
+
+	/* positions below the slot count are buckets * Slots + slot, the ones
+	 * past it index the stash */
+	struct _iterator {
+	protected:
+		const cuckoo_hash_table* _t = nullptr;
+		std::size_t _i = 0;
+	public:
+		_iterator() = default;
+		_iterator(const cuckoo_hash_table* t, std::size_t i)
+				: _t(t), _i(i) {
+			while (_i < _t->_slot_count() && !_t->_tag_at(_i))
+				++_i;
+		}
+
+		const Key& operator*() const noexcept {
+			return _t->_key_at(_i);
+		}
+
+		const Key* operator->() const noexcept {
+			return std::addressof(_t->_key_at(_i));
+		}
+
+		_iterator& operator++() noexcept {
+			do {
+				++_i;
+			} while (_i < _t->_slot_count() && !_t->_tag_at(_i));
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _i == i._i;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+	};
+public:
+	using iterator = _iterator;
+	using const_iterator = _iterator;
+
+	cuckoo_hash_table()
+			: _ml_factor(0.95f) {
+		_allocate(2);
+	}
+
+	cuckoo_hash_table(const cuckoo_hash_table& t)
+			: _ml_factor(t._ml_factor),
+			  _stash(t._stash) {
+		_allocate(t._count);
+		for (std::size_t b = 0; b < _count; ++b) {
+			for (std::size_t s = 0; s < Slots; ++s) {
+				if (std::uint8_t tag = t._buckets[b].tags[s]) {
+					new (&_buckets[b].slots[s].key) Key(t._buckets[b].slots[s].key);
+					_buckets[b].tags[s] = tag;
+				}
+			}
+		}
+		_entries = t._entries;
+	}
+
+	/* leaves t empty, as if default constructed */
+	cuckoo_hash_table(cuckoo_hash_table&& t) noexcept
+			: cuckoo_hash_table() {
+		_swap(t);
+	}
+
+	cuckoo_hash_table& operator=(cuckoo_hash_table t) noexcept {
+		_swap(t);
+		return *this;
+	}
+
+	~cuckoo_hash_table() {
+		_destroy();
+	}
+
+	/* at least `count` slots, rounded up to a power of two number of buckets
+	 * that also keeps the load factor under the maximum */
+	void rehash(std::size_t count) {
+		std::size_t n = 2;
+		while (n * Slots < count || _entries > n * Slots * _ml_factor)
+			n *= 2;
+		_rebuild(n);
+		/* placing the keys again can overflow the stash as well */
+		while (_stash_overflow())
+			_rebuild(2 * _count);
+	}
+
+	bool insert(const Key& k) {
+		return _insert(k);
+	}
+
+	bool insert(Key&& k) {
+		return _insert(std::move(k));
+	}
+
+	const_iterator find(const Key& k) const {
+		return const_iterator(this, _find(k, _hash(k)));
+	}
+
+	bool erase(const Key& k) {
+		std::size_t i = _find(k, _hash(k));
+		if (i == _end_pos())
+			return false;
+		--_entries;
+		if (i >= _slot_count()) {
+			std::swap(_stash[i - _slot_count()], _stash.back());
+			_stash.pop_back();
+			return true;
+		}
+		bucket& b = _buckets[i / Slots];
+		b.slots[i % Slots].key.~Key();
+		b.tags[i % Slots] = 0;
+		if (!_stash.empty())
+			_unstash(i / Slots, i % Slots);
+		return true;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _slot_count();
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / bucket_count();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(this, 0);
+	}
+
+	const_iterator end() const {
+		return const_iterator(this, _end_pos());
+	}
+
+private:
+	static std::size_t _hash(const Key& k) {
+		return group_probing::mix(Hash()(k));
+	}
+
+	static std::uint8_t _tag(std::size_t h) noexcept {
+		std::uint8_t t = std::uint64_t(h) >> 56;
+		return t ? t : 1;
+	}
+
+	std::size_t _first(std::size_t h) const noexcept {
+		return h & (_count - 1);
+	}
+
+	/* the other bucket of a key with tag t in bucket b, and vice versa */
+	std::size_t _alt(std::size_t b, std::uint8_t t) const noexcept {
+		return (b ^ group_probing::mix(t)) & (_count - 1);
+	}
+
+	std::size_t _slot_count() const noexcept {
+		return _count * Slots;
+	}
+
+	std::size_t _end_pos() const noexcept {
+		return _slot_count() + _stash.size();
+	}
+
+	std::uint8_t _tag_at(std::size_t i) const noexcept {
+		return _buckets[i / Slots].tags[i % Slots];
+	}
+
+	const Key& _key_at(std::size_t i) const noexcept {
+		if (i < _slot_count())
+			return _buckets[i / Slots].slots[i % Slots].key;
+		return _stash[i - _slot_count()];
+	}
+
+	/* position of k, or _end_pos() when it is not in the table */
+	std::size_t _find(const Key& k, std::size_t h) const {
+		std::uint8_t t = _tag(h);
+		std::size_t b1 = _first(h);
+		std::size_t b2 = _alt(b1, t);
+		__builtin_prefetch(&_buckets[b2]);
+		for (std::size_t b : { b1, b2 }) {
+			for (std::uint64_t m = _match(b, t); m; m &= m - 1) {
+				std::size_t s = __builtin_ctzll(m);
+				if (KeyEqual()(k, _buckets[b].slots[s].key))
+					return b * Slots + s;
+			}
+		}
+		for (std::size_t i = 0; i < _stash.size(); ++i) {
+			if (KeyEqual()(k, _stash[i]))
+				return _slot_count() + i;
+		}
+		return _end_pos();
+	}
+
+	/* bit s is set if slot s of bucket b has tag t; built without branches,
+	 * so the compiler can compare all the tags at once */
+	std::uint64_t _match(std::size_t b, std::uint8_t t) const noexcept {
+		std::uint64_t m = 0;
+		for (std::size_t s = 0; s < Slots; ++s)
+			m |= std::uint64_t(_buckets[b].tags[s] == t) << s;
+		return m;
+	}
+
+	/* a free slot of bucket b, or Slots */
+	std::size_t _free_slot(std::size_t b) const noexcept {
+		for (std::size_t s = 0; s < Slots; ++s) {
+			if (!_buckets[b].tags[s])
+				return s;
+		}
+		return Slots;
+	}
+
+	template < typename _K >
+	void _construct(std::size_t b, std::size_t s, std::uint8_t t, _K&& k) {
+		new (&_buckets[b].slots[s].key) Key(std::forward< _K >(k));
+		_buckets[b].tags[s] = t;
+	}
+
+	void _move(std::size_t from, std::size_t fs, std::size_t to, std::size_t ts) {
+		_construct(to, ts, _buckets[from].tags[fs], std::move(_buckets[from].slots[fs].key));
+		_buckets[from].slots[fs].key.~Key();
+		_buckets[from].tags[fs] = 0;
+	}
+
+	/* Breadth-first search from both buckets of a new key for the shortest
+	 * chain of moves that frees a slot in one of them. Every bucket in the
+	 * queue is full, and a chain never visits a bucket twice, so the moves
+	 * can be replayed from the free end without checking anything again.
+	 * Returns the freed position, or _slot_count() if there is no chain. */
+	std::size_t _cuckoo(std::size_t b1, std::size_t b2) {
+		struct node {
+			std::size_t bucket;
+			std::uint16_t parent;
+			std::uint8_t slot;
+			std::uint8_t depth;
+		};
+		node q[max_nodes];
+		std::size_t n = 0;
+		q[n++] = { b1, 0, 0, 0 };
+		q[n++] = { b2, 0, 0, 0 };
+		for (std::size_t i = 0; i < n; ++i) {
+			std::size_t from = q[i].bucket;
+			for (std::size_t s = 0; s < Slots; ++s) {
+				std::size_t to = _alt(from, _buckets[from].tags[s]);
+				if (std::size_t f = _free_slot(to); f != Slots) {
+					_move(from, s, to, f);
+					std::size_t j = i;
+					for (; q[j].depth; j = q[j].parent) {
+						_move(q[q[j].parent].bucket, q[j].slot, q[j].bucket, s);
+						s = q[j].slot;
+					}
+					return q[j].bucket * Slots + s;
+				}
+				if (q[i].depth + 1u < max_depth && n < max_nodes && !_on_path(q, i, to))
+					q[n++] = { to, std::uint16_t(i), std::uint8_t(s), std::uint8_t(q[i].depth + 1) };
+			}
+		}
+		return _slot_count();
+	}
+
+	template < typename Node >
+	static bool _on_path(const Node* q, std::size_t i, std::size_t b) noexcept {
+		for (;; i = q[i].parent) {
+			if (q[i].bucket == b)
+				return true;
+			if (!q[i].depth)
+				return false;
+		}
+	}
+
+	/* into one of the buckets of h, moving other keys if need be, or into
+	 * the stash; the stash is not checked for overflow */
+	template < typename _K >
+	void _place(_K&& k, std::size_t h) {
+		std::uint8_t t = _tag(h);
+		std::size_t b1 = _first(h);
+		std::size_t b2 = _alt(b1, t);
+		if (std::size_t s = _free_slot(b1); s != Slots)
+			return _construct(b1, s, t, std::forward< _K >(k));
+		if (std::size_t s = _free_slot(b2); s != Slots)
+			return _construct(b2, s, t, std::forward< _K >(k));
+		if (std::size_t i = _cuckoo(b1, b2); i != _slot_count())
+			return _construct(i / Slots, i % Slots, t, std::forward< _K >(k));
+		_stash.emplace_back(std::forward< _K >(k));
+	}
+
+	template < typename _K >
+	bool _insert(_K&& k) {
+		std::size_t h = _hash(k);
+		if (_find(k, h) != _end_pos())
+			return false;
+		if (_entries + 1 > _slot_count() * _ml_factor)
+			rehash(2 * _slot_count());
+		_place(std::forward< _K >(k), h);
+		++_entries;
+		if (_stash_overflow())
+			rehash(2 * _slot_count());
+		return true;
+	}
+
+	/* A full stash doubles the table, unless the table is mostly empty
+	 * already: then the keys collide on the whole hash, and more buckets
+	 * would not separate them. */
+	bool _stash_overflow() const noexcept {
+		return _stash.size() > stash_size && _entries > _slot_count() / 8;
+	}
+
+	/* moves a stashed key that belongs to bucket b into its freed slot s */
+	void _unstash(std::size_t b, std::size_t s) {
+		for (std::size_t i = 0; i < _stash.size(); ++i) {
+			std::size_t h = _hash(_stash[i]);
+			std::uint8_t t = _tag(h);
+			if (_first(h) == b || _alt(_first(h), t) == b) {
+				_construct(b, s, t, std::move(_stash[i]));
+				std::swap(_stash[i], _stash.back());
+				_stash.pop_back();
+				return;
+			}
+		}
+	}
+
+	void _rebuild(std::size_t count) {
+		auto buckets = std::move(_buckets);
+		std::size_t old = _count;
+		std::vector< Key > stash;
+		stash.swap(_stash);
+		_allocate(count);
+		for (std::size_t b = 0; b < old; ++b) {
+			for (std::size_t s = 0; s < Slots; ++s) {
+				if (buckets[b].tags[s]) {
+					Key& k = buckets[b].slots[s].key;
+					_place(std::move(k), _hash(k));
+					k.~Key();
+				}
+			}
+		}
+		for (Key& k : stash)
+			_place(std::move(k), _hash(k));
+	}
+
+	void _allocate(std::size_t count) {
+		_buckets.reset(new bucket[count]);
+		_count = count;
+	}
+
+	void _destroy() noexcept {
+		for (std::size_t b = 0; b < _count; ++b)
+			for (std::size_t s = 0; s < Slots; ++s)
+				if (_buckets[b].tags[s])
+					_buckets[b].slots[s].key.~Key();
+	}
+
+	void _swap(cuckoo_hash_table& t) noexcept {
+		std::swap(_ml_factor, t._ml_factor);
+		std::swap(_buckets, t._buckets);
+		std::swap(_count, t._count);
+		std::swap(_entries, t._entries);
+		std::swap(_stash, t._stash);
+	}
+
+	float _ml_factor = 0.95f;
+	std::unique_ptr< bucket[] > _buckets;
+	std::size_t _count = 0;
+	std::size_t _entries = 0;
+	std::vector< Key > _stash;
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/* Epoch-based reclamation. Threads touch shared nodes only inside a guard,
+ * which publishes the global epoch the thread saw. A node is retired after
+ * it has been unlinked, tagged with the global epoch read at that moment;
+ * the epoch can move on only once every thread inside a guard has seen the
+ * current one, so when it is two ahead of the tag no guard can still hold
+ * the node and it is freed. Per-thread records are never freed, an exiting
+ * thread leaves its record (and its leftover garbage) to the next thread. */
+class epoch_domain {
+	struct retired {
+		void* p;
+		void (*destroy)(void*);
+		std::uint64_t epoch;
+	};
+
+	struct record {
+		/* epoch << 1 | inside a guard */
+		std::atomic< std::uint64_t > state{ 0 };
+		std::atomic< bool > owned{ true };
+		record* next = nullptr;
+		unsigned depth = 0;
+		std::vector< retired > limbo;
+	};
+
+	/* releases the record of this thread when it exits */
+	struct owner {
+		record* r = nullptr;
+
+		~owner() {
+			if (r) {
+				epoch_domain::instance()._collect(*r);
+				r->owned.store(false, std::memory_order_release);
+			}
+		}
+	};
+
+public:
+	static constexpr std::size_t collect_threshold = 64;
+
+	class guard {
+	public:
+		guard()
+				: _r(epoch_domain::instance()._self()) {
+			if (_r.depth++ == 0)
+				epoch_domain::instance()._enter(_r);
+		}
+
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+		~guard() {
+			if (--_r.depth == 0)
+				_r.state.store(_r.state.load(std::memory_order_relaxed) & ~std::uint64_t(1), std::memory_order_release);
+		}
+
+	private:
+		record& _r;
+	};
+
+	static epoch_domain& instance() {
+		static epoch_domain d;
+		return d;
+	}
+
+	~epoch_domain() {
+		for (record* r = _records.load(); r;) {
+			for (auto& g : r->limbo)
+				g.destroy(g.p);
+			record* next = r->next;
+			delete r;
+			r = next;
+		}
+	}
+
+	/* p must already be unreachable for threads entering a guard from now on */
+	template < typename T >
+	void retire(T* p) {
+		record& r = _self();
+		r.limbo.push_back({ p, [](void* q) { delete static_cast< T* >(q); }, _epoch.load() });
+		if (r.limbo.size() >= collect_threshold)
+			_collect(r);
+	}
+
+private:
+	record& _self() {
+		thread_local owner o;
+		if (!o.r)
+			o.r = _acquire();
+		return *o.r;
+	}
+
+	record* _acquire() {
+		for (record* r = _records.load(); r; r = r->next) {
+			bool expected = false;
+			if (!r->owned.load(std::memory_order_relaxed) && r->owned.compare_exchange_strong(expected, true))
+				return r;
+		}
+		record* r = new record;
+		r->next = _records.load();
+		while (!_records.compare_exchange_weak(r->next, r))
+			;
+		return r;
+	}
+
+	void _enter(record& r) {
+		/* retry until the published epoch is still the global one after the
+		 * store is visible, so an advance cannot slip in between */
+		std::uint64_t e;
+		do {
+			e = _epoch.load();
+			r.state.store(e << 1 | 1);
+		} while (e != _epoch.load());
+	}
+
+	void _try_advance() {
+		std::uint64_t e = _epoch.load();
+		for (record* r = _records.load(); r; r = r->next) {
+			std::uint64_t s = r->state.load();
+			if ((s & 1) && (s >> 1) != e)
+				return;
+		}
+		_epoch.compare_exchange_strong(e, e + 1);
+	}
+
+	void _collect(record& r) {
+		_try_advance();
+		std::uint64_t e = _epoch.load();
+		std::size_t done = 0;
+		/* tags only grow along the list */
+		while (done < r.limbo.size() && r.limbo[done].epoch + 2 <= e) {
+			r.limbo[done].destroy(r.limbo[done].p);
+			++done;
+		}
+		r.limbo.erase(r.limbo.begin(), r.limbo.begin() + done);
+	}
+
+	std::atomic< std::uint64_t > _epoch{ 0 };
+	std::atomic< record* > _records{ nullptr };
+};
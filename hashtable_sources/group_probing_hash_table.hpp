@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace group_probing {
+
+/* one control byte per slot: a 7-bit fingerprint of the hash when the slot
+ * is full, otherwise one of the negative markers below */
+using ctrl_t = std::int8_t;
+
+constexpr ctrl_t empty = -128;
+constexpr ctrl_t deleted = -2;
+
+/* `width` control bytes compared at once; bit i of a mask is slot i of the
+ * group. AVX2 and SSE2 are picked at compile time, since the group width is
+ * part of the table layout. */
+#if defined(__AVX2__)
+struct group {
+	static constexpr std::size_t width = 32;
+
+	explicit group(const ctrl_t* p) noexcept
+			: _c(_mm256_loadu_si256(reinterpret_cast< const __m256i* >(p))) {}
+
+	std::uint32_t match(ctrl_t h) const noexcept {
+		return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_c, _mm256_set1_epi8(h)));
+	}
+
+	/* empty or deleted, i.e. the sign bit is set */
+	std::uint32_t match_free() const noexcept {
+		return _mm256_movemask_epi8(_c);
+	}
+
+private:
+	__m256i _c;
+};
+#elif defined(__SSE2__)
+struct group {
+	static constexpr std::size_t width = 16;
+
+	explicit group(const ctrl_t* p) noexcept
+			: _c(_mm_loadu_si128(reinterpret_cast< const __m128i* >(p))) {}
+
+	std::uint32_t match(ctrl_t h) const noexcept {
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(_c, _mm_set1_epi8(h)));
+	}
+
+	std::uint32_t match_free() const noexcept {
+		return _mm_movemask_epi8(_c);
+	}
+
+private:
+	__m128i _c;
+};
+#else
+struct group {
+	static constexpr std::size_t width = 8;
+
+	explicit group(const ctrl_t* p) noexcept
+			: _p(p) {}
+
+	std::uint32_t match(ctrl_t h) const noexcept {
+		std::uint32_t m = 0;
+		for (std::size_t i = 0; i < width; ++i)
+			m |= std::uint32_t(_p[i] == h) << i;
+		return m;
+	}
+
+	std::uint32_t match_free() const noexcept {
+		std::uint32_t m = 0;
+		for (std::size_t i = 0; i < width; ++i)
+			m |= std::uint32_t(_p[i] < 0) << i;
+		return m;
+	}
+
+private:
+	const ctrl_t* _p;
+};
+#endif
+
+inline std::size_t trailing_zeros(std::uint32_t m) noexcept {
+	return __builtin_ctz(m);
+}
+
+/* leading zeros within the `group::width` low bits */
+inline std::size_t leading_zeros(std::uint32_t m) noexcept {
+	return __builtin_clz(m) - (32 - group::width);
+}
+
+/* spreads sequential keys (std::hash< int > is the identity) over all bits */
+inline std::size_t mix(std::size_t h) noexcept {
+	std::uint64_t x = h * 0x9E3779B97F4A7C15ull;
+	return static_cast< std::size_t >(x ^ (x >> 32));
+}
+
+} // namespace group_probing
+
+/* Open addressing with the keys in one array and a control byte per slot in
+ * another. A probe loads a whole group of control bytes, compares all of
+ * them with the 7-bit fingerprint of the hash at once and calls KeyEqual
+ * only on the matching slots; a group with an empty slot ends the probe.
+ * Groups are visited in triangular steps, which covers the whole
+ * power-of-two capacity. The first `width` control bytes are mirrored past
+ * the end, so a group read never wraps around. */
+template < typename Key,
+		typename Hash = std::hash< Key >,
+		typename KeyEqual = std::equal_to< Key > >
+class group_probing_hash_table {
+	using ctrl_t = group_probing::ctrl_t;
+	using group = group_probing::group;
+	static constexpr std::size_t width = group::width;
+
+	union slot {
+		slot() {}
+		~slot() {}
+		Key key;
+	};
+
+	struct _iterator {
+	protected:
+		const ctrl_t* _c = nullptr;
+		const ctrl_t* _e = nullptr;
+		const slot* _s = nullptr;
+	public:
+		_iterator() = default;
+		_iterator(const ctrl_t* c, const ctrl_t* e, const slot* s)
+				: _c(c), _e(e), _s(s) {
+			while (_c != _e && *_c < 0) {
+				++_c;
+				++_s;
+			}
+		}
+
+		const Key& operator*() const noexcept {
+			return _s->key;
+		}
+
+		const Key* operator->() const noexcept {
+			return std::addressof(_s->key);
+		}
+
+		_iterator& operator++() noexcept {
+			do {
+				++_c;
+				++_s;
+			} while (_c != _e && *_c < 0);
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _c == i._c;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+	};
+public:
+	using iterator = _iterator;
+	using const_iterator = _iterator;
+
+	group_probing_hash_table()
+			: _ml_factor(7.0f/8.0f) {
+		_allocate(width);
+	}
+
+	group_probing_hash_table(const group_probing_hash_table& t)
+			: _ml_factor(t._ml_factor) {
+		_allocate(t._capacity);
+		for (std::size_t i = 0; i < _capacity; ++i)
+			if (t._ctrl[i] >= 0)
+				new (&_slots[i].key) Key(t._slots[i].key);
+		std::copy(t._ctrl.get(), t._ctrl.get() + _capacity + width, _ctrl.get());
+		_entries = t._entries;
+		_deleted = t._deleted;
+	}
+
+	/* leaves t empty, as if default constructed */
+	group_probing_hash_table(group_probing_hash_table&& t) noexcept
+			: group_probing_hash_table() {
+		_swap(t);
+	}
+
+	group_probing_hash_table& operator=(group_probing_hash_table t) noexcept {
+		_swap(t);
+		return *this;
+	}
+
+	~group_probing_hash_table() {
+		_destroy();
+	}
+
+	/* at least `count` slots, rounded up to a power of two that also keeps
+	 * the load factor under the maximum */
+	void rehash(std::size_t count) {
+		std::size_t cap = width;
+		while (cap < count || _entries > cap * _ml_factor)
+			cap *= 2;
+		auto ctrl = std::move(_ctrl);
+		auto slots = std::move(_slots);
+		std::size_t old = _capacity;
+		_allocate(cap);
+		for (std::size_t i = 0; i < old; ++i) {
+			if (ctrl[i] >= 0) {
+				std::size_t h = _hash(slots[i].key);
+				std::size_t to = _find_free(h);
+				new (&_slots[to].key) Key(std::move(slots[i].key));
+				_set_ctrl(to, _h2(h));
+				slots[i].key.~Key();
+			}
+		}
+		_deleted = 0;
+	}
+
+	bool insert(const Key& k) {
+		return _insert(k);
+	}
+
+	bool insert(Key&& k) {
+		return _insert(std::move(k));
+	}
+
+	const_iterator find(const Key& k) const {
+		std::size_t i = _find(k, _hash(k));
+		return i == _capacity ? end() : const_iterator(_ctrl.get() + i, _end(), _slots.get() + i);
+	}
+
+	bool erase(const Key& k) {
+		std::size_t i = _find(k, _hash(k));
+		if (i == _capacity)
+			return false;
+		_slots[i].key.~Key();
+		--_entries;
+		/* the slot may become empty again only if no probe can have passed
+		 * over it, i.e. every window containing it still had an empty slot */
+		std::uint32_t after = group(_ctrl.get() + i).match(group_probing::empty);
+		std::uint32_t before = group(_ctrl.get() + ((i - width) & (_capacity - 1))).match(group_probing::empty);
+		if (after && before && group_probing::trailing_zeros(after) + group_probing::leading_zeros(before) < width) {
+			_set_ctrl(i, group_probing::empty);
+		} else {
+			_set_ctrl(i, group_probing::deleted);
+			++_deleted;
+		}
+		return true;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _capacity;
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / bucket_count();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(_ctrl.get(), _end(), _slots.get());
+	}
+
+	const_iterator end() const {
+		return const_iterator(_end(), _end(), _slots.get() + _capacity);
+	}
+
+private:
+	static std::size_t _hash(const Key& k) {
+		return group_probing::mix(Hash()(k));
+	}
+
+	static ctrl_t _h2(std::size_t h) noexcept {
+		return static_cast< ctrl_t >(h & 0x7f);
+	}
+
+	const ctrl_t* _end() const noexcept {
+		return _ctrl.get() + _capacity;
+	}
+
+	void _set_ctrl(std::size_t i, ctrl_t c) noexcept {
+		_ctrl[i] = c;
+		if (i < width)
+			_ctrl[_capacity + i] = c;
+	}
+
+	/* index of k, or _capacity when it is not in the table */
+	std::size_t _find(const Key& k, std::size_t h) const {
+		std::size_t mask = _capacity - 1;
+		std::size_t pos = (h >> 7) & mask;
+		for (std::size_t step = width; true; step += width) {
+			group g(_ctrl.get() + pos);
+			for (std::uint32_t m = g.match(_h2(h)); m; m &= m - 1) {
+				std::size_t i = (pos + group_probing::trailing_zeros(m)) & mask;
+				if (KeyEqual()(k, _slots[i].key))
+					return i;
+			}
+			if (g.match(group_probing::empty))
+				return _capacity;
+			pos = (pos + step) & mask;
+		}
+	}
+
+	/* first empty or deleted slot on the probe sequence of h */
+	std::size_t _find_free(std::size_t h) const noexcept {
+		std::size_t mask = _capacity - 1;
+		std::size_t pos = (h >> 7) & mask;
+		for (std::size_t step = width; true; step += width) {
+			if (std::uint32_t m = group(_ctrl.get() + pos).match_free())
+				return (pos + group_probing::trailing_zeros(m)) & mask;
+			pos = (pos + step) & mask;
+		}
+	}
+
+	template < typename _K >
+	bool _insert(_K&& k) {
+		std::size_t h = _hash(k);
+		if (_find(k, h) != _capacity)
+			return false;
+		std::size_t i = _find_free(h);
+		/* at least one slot stays empty, so every probe terminates */
+		std::size_t limit = std::min< std::size_t >(_capacity * _ml_factor, _capacity - 1);
+		if (_ctrl[i] == group_probing::empty && _entries + _deleted + 1 > limit) {
+			/* mostly tombstones: clean up at the same size */
+			rehash(_deleted > _entries ? _capacity : 2 * _capacity);
+			i = _find_free(h);
+		}
+		if (_ctrl[i] == group_probing::deleted)
+			--_deleted;
+		new (&_slots[i].key) Key(std::forward< _K >(k));
+		_set_ctrl(i, _h2(h));
+		++_entries;
+		return true;
+	}
+
+	void _allocate(std::size_t cap) {
+		_ctrl.reset(new ctrl_t[cap + width]);
+		std::fill(_ctrl.get(), _ctrl.get() + cap + width, group_probing::empty);
+		_slots.reset(new slot[cap]);
+		_capacity = cap;
+	}
+
+	void _destroy() noexcept {
+		for (std::size_t i = 0; i < _capacity; ++i)
+			if (_ctrl[i] >= 0)
+				_slots[i].key.~Key();
+	}
+
+	void _swap(group_probing_hash_table& t) noexcept {
+		std::swap(_ml_factor, t._ml_factor);
+		std::swap(_ctrl, t._ctrl);
+		std::swap(_slots, t._slots);
+		std::swap(_capacity, t._capacity);
+		std::swap(_entries, t._entries);
+		std::swap(_deleted, t._deleted);
+	}
+
+	float _ml_factor = 7.0f/8.0f;
+	std::unique_ptr< ctrl_t[] > _ctrl;
+	std::unique_ptr< slot[] > _slots;
+	std::size_t _capacity = 0;
+	std::size_t _entries = 0;
+	std::size_t _deleted = 0;
+};
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "index_policy.hpp"
+#include "linear_probing_hash_table.hpp"
+
+/* On-disk open-addressing set, usable straight from the page cache:
+ *
+ *     header page | one control byte per bucket | pad to 64 | keys
+ *
+ * A control byte is 0 for an empty bucket and 0x80 | 7 bits of the key's
+ * hash otherwise, so a zero-filled file is an empty table and most probes
+ * reject a bucket without loading its key. Keys sit in their buckets as
+ * raw bytes and are found by linear probing from Index()(Hash()(key)); a
+ * snapshot has to be opened with the Hash and Index it was written with,
+ * only the bucket count is checked against the Index. */
+struct snapshot_header {
+	static constexpr char magic_value[8] = { 'H', 'S', 'H', 'S', 'N', 'A', 'P', '\0' };
+	static constexpr std::uint32_t current_version = 1;
+	static constexpr std::size_t size = 4096;
+
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t key_size;
+	std::uint64_t buckets;
+	std::uint64_t entries;
+
+	static std::size_t keys_offset(std::size_t buckets) noexcept {
+		return (size + buckets + 63) / 64 * 64;
+	}
+
+	static std::uint8_t control(std::size_t hash) noexcept {
+		return 0x80 | std::uint8_t((std::uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> 57);
+	}
+};
+
+/* Builds a snapshot in place in a new file, one key at a time, so a set
+ * never has to exist in memory first. The number of keys has to be known
+ * up front. The header is written last, by finish() or the destructor; a
+ * file left without it is not a valid snapshot. */
+template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index >
+class snapshot_writer {
+	static_assert(std::is_trivially_copyable< Key >::value, "snapshot keys must be trivially copyable");
+
+public:
+	/* room for `capacity` keys at a load factor of at most `max_load` */
+	snapshot_writer(const std::string& path, std::size_t capacity, float max_load = 2.0f/3.0f) {
+		std::size_t count = std::ceil(capacity / max_load);
+		_buckets = _index.round(std::max(count, capacity + 1));
+		_index.reset(_buckets);
+		_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (_fd < 0)
+			throw std::runtime_error("cannot create " + path);
+		_bytes = snapshot_header::keys_offset(_buckets) + _buckets * sizeof(Key);
+		if (ftruncate(_fd, _bytes) != 0) {
+			close(_fd);
+			throw std::runtime_error("cannot resize " + path);
+		}
+		void* p = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+		if (p == MAP_FAILED) {
+			close(_fd);
+			throw std::runtime_error("mmap failed");
+		}
+		_map = static_cast< char* >(p);
+	}
+
+	snapshot_writer(const snapshot_writer&) = delete;
+	snapshot_writer& operator=(const snapshot_writer&) = delete;
+
+	~snapshot_writer() {
+		finish();
+	}
+
+	/* false if k is already in */
+	bool add(const Key& k) {
+		if (!_map)
+			throw std::logic_error("snapshot already finished");
+		std::size_t h = Hash()(k);
+		std::uint8_t c = snapshot_header::control(h);
+		auto ctrl = reinterpret_cast< std::uint8_t* >(_map + snapshot_header::size);
+		char* keys = _map + snapshot_header::keys_offset(_buckets);
+		for (std::size_t b = _index(h);; b = b + 1 == _buckets ? 0 : b + 1) {
+			if (ctrl[b] == 0) {
+				/* one bucket always stays empty to end every probe */
+				if (_entries + 1 == _buckets)
+					throw std::logic_error("snapshot is full");
+				std::memcpy(keys + b * sizeof(Key), &k, sizeof(Key));
+				ctrl[b] = c;
+				++_entries;
+				return true;
+			}
+			if (ctrl[b] == c && KeyEqual()(*reinterpret_cast< const Key* >(keys + b * sizeof(Key)), k))
+				return false;
+		}
+	}
+
+	void finish() noexcept {
+		if (!_map)
+			return;
+		snapshot_header h;
+		std::memcpy(h.magic, snapshot_header::magic_value, sizeof(h.magic));
+		h.version = snapshot_header::current_version;
+		h.key_size = sizeof(Key);
+		h.buckets = _buckets;
+		h.entries = _entries;
+		std::memcpy(_map, &h, sizeof(h));
+		munmap(_map, _bytes);
+		close(_fd);
+		_map = nullptr;
+		_fd = -1;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _buckets;
+	}
+
+private:
+	int _fd = -1;
+	char* _map = nullptr;
+	std::size_t _bytes = 0;
+	std::size_t _buckets = 0;
+	std::size_t _entries = 0;
+	Index _index;
+};
+
+/* Read-only set over a snapshot file. Opening maps the file and checks the
+ * header, nothing is read or built; pages are faulted in by lookups and are
+ * shared by every process that maps the same file. */
+template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index >
+class mapped_hash_set {
+	static_assert(std::is_trivially_copyable< Key >::value, "snapshot keys must be trivially copyable");
+
+	struct _iterator {
+	protected:
+		const std::uint8_t* _c = nullptr;
+		const std::uint8_t* _e = nullptr;
+		const Key* _k = nullptr;
+
+	public:
+		_iterator() = default;
+		_iterator(const std::uint8_t* c, const std::uint8_t* e, const Key* k)
+				: _c(c), _e(e), _k(k) {
+			if (_c != _e && !*_c)
+				++(*this);
+		}
+
+		const Key& operator*() const noexcept {
+			return *_k;
+		}
+
+		const Key* operator->() const noexcept {
+			return _k;
+		}
+
+		_iterator& operator++() noexcept {
+			do {
+				++_c;
+				++_k;
+			} while (_c != _e && !*_c);
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _c == i._c;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+	};
+public:
+	using iterator = _iterator;
+	using const_iterator = _iterator;
+
+	/* empty, as is a moved-from set */
+	mapped_hash_set() = default;
+
+	mapped_hash_set(const mapped_hash_set&) = delete;
+	mapped_hash_set& operator=(const mapped_hash_set&) = delete;
+
+	mapped_hash_set(mapped_hash_set&& m) noexcept {
+		*this = std::move(m);
+	}
+
+	mapped_hash_set& operator=(mapped_hash_set&& m) noexcept {
+		std::swap(_fd, m._fd);
+		std::swap(_map, m._map);
+		std::swap(_bytes, m._bytes);
+		std::swap(_buckets, m._buckets);
+		std::swap(_entries, m._entries);
+		std::swap(_index, m._index);
+		return *this;
+	}
+
+	~mapped_hash_set() {
+		if (_map)
+			munmap(_map, _bytes);
+		if (_fd >= 0)
+			close(_fd);
+	}
+
+	static mapped_hash_set open(const std::string& path) {
+		mapped_hash_set m;
+		m._fd = ::open(path.c_str(), O_RDONLY);
+		if (m._fd < 0)
+			throw std::runtime_error("cannot open " + path);
+		struct stat st;
+		if (fstat(m._fd, &st) != 0 || std::size_t(st.st_size) < snapshot_header::size)
+			throw std::runtime_error("not a snapshot file: " + path);
+		m._bytes = st.st_size;
+		void* p = mmap(nullptr, m._bytes, PROT_READ, MAP_SHARED, m._fd, 0);
+		if (p == MAP_FAILED)
+			throw std::runtime_error("mmap failed");
+		m._map = static_cast< char* >(p);
+		snapshot_header h;
+		std::memcpy(&h, m._map, sizeof(h));
+		if (std::memcmp(h.magic, snapshot_header::magic_value, sizeof(h.magic)) != 0
+				|| h.version != snapshot_header::current_version)
+			throw std::runtime_error("not a snapshot file: " + path);
+		if (h.key_size != sizeof(Key))
+			throw std::runtime_error("key size mismatch: " + path);
+		if (h.buckets == 0 || m._index.round(h.buckets) != h.buckets)
+			throw std::runtime_error("bucket count does not fit the index policy: " + path);
+		m._buckets = h.buckets;
+		m._entries = h.entries;
+		if (m._bytes < snapshot_header::keys_offset(m._buckets) + m._buckets * sizeof(Key))
+			throw std::runtime_error("truncated snapshot file: " + path);
+		m._index.reset(m._buckets);
+		return m;
+	}
+
+	const_iterator find(const Key& k) const {
+		if (!_buckets)
+			return end();
+		std::size_t h = Hash()(k);
+		std::uint8_t c = snapshot_header::control(h);
+		for (std::size_t b = _index(h); _ctrl()[b]; b = b + 1 == _buckets ? 0 : b + 1) {
+			if (_ctrl()[b] == c && KeyEqual()(_keys()[b], k))
+				return const_iterator(_ctrl() + b, _ctrl() + _buckets, _keys() + b);
+		}
+		return end();
+	}
+
+	bool contains(const Key& k) const {
+		return find(k) != end();
+	}
+
+	std::size_t size() const noexcept {
+		return _entries;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _buckets;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(_ctrl(), _ctrl() + _buckets, _keys());
+	}
+
+	const_iterator end() const {
+		return const_iterator(_ctrl() + _buckets, _ctrl() + _buckets, _keys() + _buckets);
+	}
+
+private:
+	/* null for a set without a file, which is empty */
+	const std::uint8_t* _ctrl() const noexcept {
+		if (!_map)
+			return nullptr;
+		return reinterpret_cast< const std::uint8_t* >(_map + snapshot_header::size);
+	}
+
+	const Key* _keys() const noexcept {
+		if (!_map)
+			return nullptr;
+		return reinterpret_cast< const Key* >(_map + snapshot_header::keys_offset(_buckets));
+	}
+
+	int _fd = -1;
+	char* _map = nullptr;
+	std::size_t _bytes = 0;
+	std::size_t _buckets = 0;
+	std::size_t _entries = 0;
+	Index _index;
+};
+
+/* streams the keys of t into a new snapshot at `path` */
+template < typename Key, typename Hash, typename KeyEqual, typename Index, bool StoreHash, std::size_t Inline >
+void write_snapshot(const std::string& path,
+		const linear_probing_hash_table< Key, Hash, KeyEqual, Index, StoreHash, Inline >& t) {
+	std::size_t n = 0;
+	for (auto it = t.begin(); it != t.end(); ++it)
+		++n;
+	snapshot_writer< Key, Hash, KeyEqual, Index > w(path, n);
+	for (const Key& k : t)
+		w.add(k);
+	w.finish();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+
+/* Index policies map a hash to one of `size` buckets and decide which bucket
+ * counts a table may use. A table calls round() on every requested count,
+ * reset() whenever its number of buckets changes and operator() on every
+ * lookup:
+ *
+ *     std::size_t round(std::size_t count) const;   // allowed count >= count,
+ *                                                   // else std::length_error
+ *     void reset(std::size_t size);
+ *     std::size_t operator()(std::size_t hash) const;
+ */
+
+/* any bucket count, hash % size: one integer division per lookup */
+struct modulo_index {
+	std::size_t round(std::size_t count) const noexcept {
+		return std::max< std::size_t >(count, 1);
+	}
+
+	void reset(std::size_t size) noexcept {
+		_size = size;
+	}
+
+	std::size_t operator()(std::size_t hash) const noexcept {
+		return hash % _size;
+	}
+
+private:
+	std::size_t _size = 1;
+};
+
+/* power-of-two bucket counts; the hash is mixed by the murmur3 finalizer
+ * and masked, so identity hashes of sequential keys spread out */
+struct mask_index {
+	std::size_t round(std::size_t count) const noexcept {
+		std::size_t size = 1;
+		while (size < count)
+			size *= 2;
+		return size;
+	}
+
+	void reset(std::size_t size) noexcept {
+		_mask = size - 1;
+	}
+
+	std::size_t operator()(std::size_t hash) const noexcept {
+		std::uint64_t h = hash;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h & _mask;
+	}
+
+private:
+	std::size_t _mask = 0;
+};
+
+/* power-of-two bucket counts; fibonacci hashing takes the top bits of
+ * hash * 2^64 / phi, a single multiply and shift */
+struct fibonacci_index {
+	std::size_t round(std::size_t count) const noexcept {
+		return mask_index().round(count);
+	}
+
+	void reset(std::size_t size) noexcept {
+		std::size_t bits = 0;
+		while ((std::size_t(1) << bits) < size)
+			++bits;
+		/* a single bucket keeps no bits at all */
+		_shift = bits ? 64 - bits : 0;
+		_mask = size - 1;
+	}
+
+	std::size_t operator()(std::size_t hash) const noexcept {
+		return ((std::uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> _shift) & _mask;
+	}
+
+private:
+	unsigned _shift = 0;
+	std::size_t _mask = 0;
+};
+
+/* prime bucket counts, roughly doubling; the modulo is computed with a
+ * precomputed 64-bit reciprocal (Lemire's fastmod) instead of a division.
+ * The hash is folded to 32 bits, the widest numerator the method covers. */
+struct prime_index {
+	/* throws std::length_error past the largest prime in the table */
+	std::size_t round(std::size_t count) const {
+		auto it = std::lower_bound(std::begin(_primes), std::end(_primes), count);
+		if (it == std::end(_primes))
+			throw std::length_error("too many buckets for prime_index");
+		return *it;
+	}
+
+	void reset(std::size_t size) noexcept {
+		_size = size;
+		_magic = ~std::uint64_t(0) / size + 1;
+	}
+
+	std::size_t operator()(std::size_t hash) const noexcept {
+		__extension__ typedef unsigned __int128 u128;
+		std::uint32_t h = std::uint32_t(hash ^ (std::uint64_t(hash) >> 32));
+		std::uint64_t low = _magic * h;
+		return std::size_t((u128(low) * _size) >> 64);
+	}
+
+private:
+	static constexpr std::uint32_t _primes[] = {
+		2u, 5u, 11u, 23u, 53u, 97u, 193u, 389u, 769u, 1543u, 3079u, 6151u,
+		12289u, 24593u, 49157u, 98317u, 196613u, 393241u, 786433u, 1572869u,
+		3145739u, 6291469u, 12582917u, 25165843u, 50331653u, 100663319u,
+		201326611u, 402653189u, 805306457u, 1610612741u, 4294967291u
+	};
+
+	std::uint64_t _magic = 1;
+	std::size_t _size = 1;
+};
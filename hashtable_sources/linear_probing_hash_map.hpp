@@ -0,0 +1,333 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "bucket_array.hpp"
+#include "index_policy.hpp"
+
+/* Map counterpart of linear_probing_hash_table. Keys and values are kept in
+ * two parallel arrays: probing walks only the key array, so a probe touches
+ * as many keys per cache line as the set does whatever the size of T, and a
+ * value is loaded only once its key has matched. Iterators dereference to a
+ * pair of references into both arrays. */
+template < typename Key,
+		typename T,
+		typename Hash = std::hash< Key >,
+		typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index >
+class linear_probing_hash_map {
+	struct bucket {
+		/* `moving` only exists during an in-place rehash */
+		enum class state : uint8_t { empty, occupied, zombie, moving };
+
+		template < typename K >
+		void set(K&& k) {
+			_key = std::forward< K >(k);
+			_state = state::occupied;
+		}
+
+		const Key& key() const noexcept {
+			return _key.value();
+		}
+
+		Key& key() noexcept {
+			return _key.value();
+		}
+
+		bool empty() const noexcept { return _state == state::empty; }
+
+		bool occupied() const noexcept { return _state == state::occupied; }
+
+		bool zombie() const noexcept { return _state == state::zombie; }
+
+		bool moving() const noexcept { return _state == state::moving; }
+
+		void zombify() noexcept {
+			_key.reset();
+			_state = state::zombie;
+		}
+
+		void clear() noexcept {
+			_key.reset();
+			_state = state::empty;
+		}
+
+		void unsettle() noexcept {
+			_state = state::moving;
+		}
+
+		void settle() noexcept {
+			_state = state::occupied;
+		}
+
+	private:
+		std::optional< Key > _key;
+		state _state = state::empty;
+	};
+
+	using keys = bucket_array< bucket >;
+	using values = bucket_array< std::optional< T > >;
+
+	template < typename B, typename V >
+	struct _iterator {
+		using reference = std::pair< const Key&, V& >;
+
+		struct pointer {
+			reference r;
+
+			reference* operator->() noexcept {
+				return std::addressof(r);
+			}
+		};
+
+		using slot = std::conditional_t< std::is_const< V >::value,
+				const std::optional< std::remove_const_t< V > >, std::optional< V > >;
+
+	protected:
+		B* _k = nullptr;
+		B* _end = nullptr;
+		slot* _v = nullptr;
+
+	public:
+		_iterator() = default;
+		_iterator(B* k, B* e, slot* v)
+				: _k(k), _end(e), _v(v) {
+			if (k != e && !k->occupied())
+				++(*this);
+		}
+
+		/* iterator to const_iterator */
+		template < typename C, typename W >
+		_iterator(const _iterator< C, W >& i)
+				: _k(i._k), _end(i._end), _v(i._v) {}
+
+		reference operator*() const noexcept {
+			return { _k->key(), **_v };
+		}
+
+		pointer operator->() const noexcept {
+			return { **this };
+		}
+
+		_iterator& operator++() noexcept {
+			do {
+				++_k;
+				++_v;
+			} while (_k != _end && !_k->occupied());
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _k == i._k && _end == i._end;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+
+		template < typename, typename >
+		friend struct _iterator;
+	};
+public:
+	using iterator = _iterator< bucket, T >;
+	using const_iterator = _iterator< const bucket, const T >;
+
+	linear_probing_hash_map()
+			: _ml_factor(2.0f/3.0f),
+			  _keys(Index().round(1)),
+			  _values(_keys.size()) {
+		_index.reset(bucket_count());
+	}
+
+	/* in place, moving each value along with its key; see
+	 * linear_probing_hash_table::rehash */
+	void rehash(std::size_t count) {
+		count = _index.round(std::max(count, _entries + 1));
+		std::size_t old = bucket_count();
+		_index.reset(count);
+		for (auto& b : _keys) {
+			if (b.zombie())
+				b.clear();
+			else if (b.occupied())
+				b.unsettle();
+		}
+		if (count < old) {
+			for (std::size_t i = count; i < old; ++i)
+				_settle(i, count);
+		}
+		_keys.resize(count);
+		_values.resize(count);
+		for (std::size_t i = 0; i < count; ++i)
+			_settle(i, count);
+		_zombies = 0;
+	}
+
+	const_iterator find(const Key& k) const {
+		return _at(_find(k));
+	}
+
+	iterator find(const Key& k) {
+		return _at(_find(k));
+	}
+
+	/* constructs the value from args only if k is not present yet */
+	template < typename... Args >
+	std::pair< iterator, bool > try_emplace(const Key& k, Args&&... args) {
+		return _try_emplace(k, std::forward< Args >(args)...);
+	}
+
+	template < typename... Args >
+	std::pair< iterator, bool > try_emplace(Key&& k, Args&&... args) {
+		return _try_emplace(std::move(k), std::forward< Args >(args)...);
+	}
+
+	template < typename M >
+	std::pair< iterator, bool > insert_or_assign(const Key& k, M&& m) {
+		auto r = try_emplace(k, std::forward< M >(m));
+		if (!r.second)
+			r.first->second = std::forward< M >(m);
+		return r;
+	}
+
+	template < typename M >
+	std::pair< iterator, bool > insert_or_assign(Key&& k, M&& m) {
+		auto r = try_emplace(std::move(k), std::forward< M >(m));
+		if (!r.second)
+			r.first->second = std::forward< M >(m);
+		return r;
+	}
+
+	T& operator[](const Key& k) {
+		return try_emplace(k).first->second;
+	}
+
+	T& operator[](Key&& k) {
+		return try_emplace(std::move(k)).first->second;
+	}
+
+	bool erase(const Key& k) {
+		std::size_t i = _find(k);
+		if (i == bucket_count())
+			return false;
+		_keys[i].zombify();
+		_values[i].reset();
+		--_entries;
+		++_zombies;
+		return true;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _keys.size();
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / bucket_count();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	iterator begin() {
+		return _at(0);
+	}
+
+	const_iterator begin() const {
+		return _at(0);
+	}
+
+	iterator end() {
+		return _at(bucket_count());
+	}
+
+	const_iterator end() const {
+		return _at(bucket_count());
+	}
+
+private:
+	iterator _at(std::size_t i) {
+		return iterator(_keys.begin() + i, _keys.end(), _values.begin() + i);
+	}
+
+	const_iterator _at(std::size_t i) const {
+		return const_iterator(_keys.begin() + i, _keys.end(), _values.begin() + i);
+	}
+
+	/* bucket holding k, bucket_count() if none */
+	std::size_t _find(const Key& k) const {
+		std::size_t b = _index(Hash()(k));
+		for (std::size_t i = 0; i < bucket_count(); ++i, ++b) {
+			if (b == bucket_count())
+				b = 0;
+			if (_keys[b].empty())
+				break;
+			if (_keys[b].occupied() && KeyEqual()(k, _keys[b].key()))
+				return b;
+		}
+		return bucket_count();
+	}
+
+	void _settle(std::size_t i, std::size_t count) {
+		while (_keys[i].moving()) {
+			std::size_t t = _index(Hash()(_keys[i].key()));
+			while (_keys[t].occupied())
+				t = t + 1 == count ? 0 : t + 1;
+			if (t == i) {
+				_keys[i].settle();
+			} else if (_keys[t].empty()) {
+				_keys[t].set(std::move(_keys[i].key()));
+				_values[t] = std::move(_values[i]);
+				_keys[i].clear();
+				_values[i].reset();
+			} else {
+				using std::swap;
+				swap(_keys[t].key(), _keys[i].key());
+				swap(_values[t], _values[i]);
+				_keys[t].settle();
+			}
+		}
+	}
+
+	template < typename _K, typename... Args >
+	std::pair< iterator, bool > _try_emplace(_K&& k, Args&&... args) {
+		if (std::size_t i = _find(k); i != bucket_count())
+			return { _at(i), false };
+		/* grow first, so that the new key is never moved by a rehash */
+		while (float(_entries + _zombies + 1) / bucket_count() > _ml_factor)
+			rehash(_zombies > _entries ? bucket_count() : 2 * bucket_count());
+		std::size_t b = _index(Hash()(k));
+		for (std::size_t i = 0; i < bucket_count(); ++i, ++b) {
+			if (b == bucket_count())
+				b = 0;
+			if (!_keys[b].occupied()) {
+				if (_keys[b].zombie())
+					--_zombies;
+				_values[b].emplace(std::forward< Args >(args)...);
+				_keys[b].set(std::forward< _K >(k));
+				++_entries;
+				return { _at(b), true };
+			}
+		}
+		throw std::logic_error("invalid hash_table");
+	}
+
+	float _ml_factor;
+	keys _keys;
+	values _values;
+	Index _index;
+	std::size_t _entries = 0;
+	std::size_t _zombies = 0;
+};
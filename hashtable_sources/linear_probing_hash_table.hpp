@@ -1,16 +1,39 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iterator>
 #include <memory>
 #include <optional>
-#include <vector>
 #include <stdexcept>
-
+#include <type_traits>
+
+#include "bucket_array.hpp"
+#include "index_policy.hpp"
+#include "rehash_report.hpp"
+#include "stored_hash.hpp"
+
+/* With StoreHash every bucket also keeps the hash of its key, see
+ * stored_hash. With Inline > 0 the first Inline keys are kept packed in
+ * buckets inside the table object and found by a plain scan; the bucket
+ * array is allocated, and the keys hashed, only when one more arrives or
+ * rehash()/reserve() asks for more. Moving such a table invalidates its
+ * iterators. */
 template < typename Key,
 		typename Hash = std::hash< Key >,
-		typename KeyEqual = std::equal_to< Key > >
+		typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index,
+		bool StoreHash = false,
+		std::size_t Inline = 0 >
 class linear_probing_hash_table {
-	struct bucket {
-		enum class state : uint8_t { empty, occupied, zombie };
+	using hash_base = stored_hash< StoreHash >;
+
+	struct bucket : hash_base {
+		/* `moving` only exists during an in-place rehash: the key is still
+		 * here but not yet at its final position */
+		enum class state : uint8_t { empty, occupied, zombie, moving };
 
 		bucket() = default;
 
@@ -19,25 +42,6 @@ class linear_probing_hash_table {
 				: _key(k),
 				  _state(state::occupied) {}
 
-		bucket(const bucket&) = default;
-
-		bucket(bucket&& b) noexcept
-				: _key(std::move(b._key)),
-				  _state(b._state) {
-			if (b.occupied())
-				b._state = state::zombie;
-		}
-
-		bucket& operator=(const bucket&) = default;
-
-		bucket& operator=(bucket&& b) noexcept {
-			_key = std::move(b._key);
-			_state = b._state;
-			if (b.occupied())
-				b._state = state::zombie;
-			return *this;
-		}
-
 		template < typename K >
 		bucket& operator=(K&& k) {
 			_key = std::forward < K >(k);
@@ -49,12 +53,18 @@ class linear_probing_hash_table {
 			return _key.value();
 		}
 
+		Key& value() noexcept {
+			return _key.value();
+		}
+
 		bool empty() const noexcept  { return _state == state::empty; }
 
 		bool occupied() const noexcept { return _state == state::occupied ;}
 
 		bool zombie() const noexcept { return _state == state::zombie; }
 
+		bool moving() const noexcept { return _state == state::moving; }
+
 		void zombify() {
 			if (occupied()) {
 				_key.reset();
@@ -62,12 +72,25 @@ class linear_probing_hash_table {
 			}
 		}
 
+		void clear() noexcept {
+			_key.reset();
+			_state = state::empty;
+		}
+
+		void unsettle() noexcept {
+			_state = state::moving;
+		}
+
+		void settle() noexcept {
+			_state = state::occupied;
+		}
+
 	private:
 		std::optional< Key > _key;
 		state _state = state::empty;
 	};
 
-	using vector = std::vector< bucket >;
+	using vector = bucket_array< bucket >;
 
 	template < typename Base, typename T >
 	struct _iterator {
@@ -78,7 +101,7 @@ class linear_probing_hash_table {
 		_iterator() = default;
 		_iterator(Base c, Base e)
 				: _cur(c), _end(e) {
-			if (c != e)
+			if (c != e && !c->occupied())
 				++(*this);
 		}
 
@@ -121,28 +144,66 @@ public:
 
 	linear_probing_hash_table()
 			: _ml_factor(2.0f/3.0f),
-			  _data(1) {}
+			  _data(Inline ? 0 : Index().round(1)) {
+		_index.reset(Index().round(1));
+	}
 
-	void rehash(std::size_t count) {
-		auto tmp = std::move(_data);
-		_data.resize(count);
-		auto olen = _entries;
-		_entries = 0;
-		for (auto& b : tmp) {
-			if (_entries == olen)
-				break;
-			if (b.occupied()) {
-				for (auto it = _data.begin() + Hash()(b.value()) % bucket_count(); true; ++it) {
-					if (it == _data.end())
-						it = _data.begin();
-					if (it->empty()) {
-						*it = std::move(b);
-						++_entries;
-						break;
-					}
-				}
-			}
+	/* sized once for all the keys in [first, last) when that can be counted */
+	template < typename It >
+	linear_probing_hash_table(It first, It last)
+			: linear_probing_hash_table() {
+		using category = typename std::iterator_traits< It >::iterator_category;
+		if constexpr (std::is_base_of< std::forward_iterator_tag, category >::value)
+			reserve(std::distance(first, last));
+		for (; first != last; ++first)
+			insert(*first);
+	}
+
+	/* Resizes the bucket array in place and moves every key to its new
+	 * position without a second table: all keys are first marked as moving,
+	 * then each one goes to the first bucket on its probe sequence that does
+	 * not hold a settled key, trading places with a moving key found there.
+	 * Settled keys are never touched again and only ever sit behind settled
+	 * keys, so every probe sequence stays unbroken. Zombies are dropped. */
+	rehash_report rehash(std::size_t count) {
+		if (_is_small())
+			return _promote(count);
+		auto start = std::chrono::steady_clock::now();
+		count = _index.round(std::max(count, _entries + 1));
+		std::size_t old = bucket_count();
+		_index.reset(count);
+		for (auto& b : _data) {
+			if (b.zombie())
+				b.clear();
+			else if (b.occupied())
+				b.unsettle();
+		}
+		/* keys past the new end have to find a place first */
+		if (count < old) {
+			for (std::size_t i = count; i < old; ++i)
+				_settle(i, count);
 		}
+		_data.resize(count);
+		for (std::size_t i = 0; i < count; ++i)
+			_settle(i, count);
+		_zombies = 0;
+		return { _data.last_resize_bytes(), std::chrono::steady_clock::now() - start };
+	}
+
+	/* drops all zombies, keeping the number of buckets */
+	rehash_report compact() {
+		if (_is_small())
+			return {};
+		return rehash(bucket_count());
+	}
+
+	/* makes room for n keys without a rehash on the way */
+	void reserve(std::size_t n) {
+		if (_is_small() && n <= Inline)
+			return;
+		std::size_t count = std::ceil(n / _ml_factor);
+		if (_is_small() || count > bucket_count())
+			rehash(count);
 	}
 
 	bool insert(const Key& k) {
@@ -154,45 +215,82 @@ public:
 	}
 
 	const_iterator find(const Key& k) const {
-		auto it = _data.begin() + Hash()(k) % bucket_count();
-		for (std::size_t i = 0; i < bucket_count(); ++it, ++i) {
-			if (it == _data.end())
-				it = _data.begin();
-			if (it->empty())
-				break;
-			if (it->occupied() && KeyEqual()(k, it->value()))
-				return end();
-		}
-		return const_iterator(it, _data.end());
+		return find(k, _hash(k));
 	}
 
 	iterator find(const Key& k) {
-		auto it = _data.begin() + Hash()(k) % bucket_count();
-		for (std::size_t i = 0; i < bucket_count(); ++it, ++i) {
-			if (it == _data.end())
-				it = _data.begin();
-			if (it->empty())
-				break;
-			if (it->occupied() && KeyEqual()(k, it->value()))
-				return end();
-		}
-		return iterator(it, _data.end());
+		return find(k, _hash(k));
+	}
+
+	/* lookup and insert for callers that already have hash == Hash()(k) */
+	const_iterator find(const Key& k, std::size_t hash) const {
+		return _at(_find(k, hash, _index(hash)));
+	}
+
+	iterator find(const Key& k, std::size_t hash) {
+		return _at(_find(k, hash, _index(hash)));
+	}
+
+	bool insert(const Key& k, std::size_t hash) {
+		return _insert(k, hash, _index(hash));
+	}
+
+	bool insert(Key&& k, std::size_t hash) {
+		return _insert(std::move(k), hash, _index(hash));
+	}
+
+	/* Batched versions of find, find(k) != end() and insert over keys[0, n).
+	 * A batch of keys is hashed and all their home buckets are prefetched
+	 * before any probe runs, so the cache misses of independent keys overlap
+	 * instead of being waited for one by one. */
+	void find_many(const Key* keys, std::size_t n, const_iterator* out) const {
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			out[i] = _at(_find(keys[i], h, b));
+		});
+	}
+
+	void contains_many(const Key* keys, std::size_t n, bool* out) const {
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			out[i] = _find(keys[i], h, b) != bucket_count();
+		});
+	}
+
+	/* returns the number of keys that were not present yet */
+	std::size_t insert_many(const Key* keys, std::size_t n) {
+		reserve(_entries + n);
+		std::size_t inserted = 0, count = bucket_count();
+		_batched(keys, n, [&](std::size_t i, std::size_t h, std::size_t b) {
+			/* rounding may still let one insert grow the table */
+			if (bucket_count() != count)
+				b = _index(h);
+			inserted += _insert(keys[i], h, b);
+		});
+		return inserted;
 	}
 
 	bool erase(const Key& k) {
-		if (auto it = find(k); it != this->end()) {
-			static_cast< typename vector::iterator >(it)->zombify();
-			return true;
+		std::size_t h = _hash(k);
+		std::size_t i = _find(k, h, _index(h));
+		if (i == bucket_count())
+			return false;
+		if (_is_small()) {
+			/* the last inline key fills the hole */
+			std::swap(_small[i], _small[_entries - 1]);
+			_small[_entries - 1].clear();
+		} else {
+			_data[i].zombify();
+			++_zombies;
 		}
-		return false;
+		--_entries;
+		return true;
 	}
 
 	std::size_t bucket_count() const noexcept {
-		return _data.size();
+		return _is_small() ? Inline : _data.size();
 	}
 
 	float load_factor() const noexcept {
-		return _entries / bucket_count();
+		return float(_entries) / bucket_count();
 	}
 
 	void max_load_factor(float ml) noexcept {
@@ -200,44 +298,179 @@ public:
 	}
 
 	iterator begin() {
-		return iterator(_data.begin(), _data.end());
+		return _at(0);
 	}
 
 	const_iterator begin() const {
-		return const_iterator(_data.begin(), _data.end());
+		return _at(0);
 	}
 
 	iterator end() {
-		return iterator(_data.end(), _data.end());
+		return _at(bucket_count());
 	}
 
 	const_iterator end() const {
-		return const_iterator(_data.end(), _data.end());
+		return _at(bucket_count());
 	}
 
 private:
+	static constexpr std::size_t _batch = 16;
+
+	bool _is_small() const noexcept {
+		return Inline && _data.size() == 0;
+	}
+
+	/* Hash()(k), except in small mode without stored hashes: the inline
+	 * scan then compares keys only and the hash would be thrown away */
+	std::size_t _hash(const Key& k) const {
+		return _is_small() && !StoreHash ? 0 : Hash()(k);
+	}
+
+	/* moves the inline keys to a bucket array of at least `count` buckets */
+	rehash_report _promote(std::size_t count) {
+		auto start = std::chrono::steady_clock::now();
+		count = _index.round(std::max(count, _entries + 1));
+		_index.reset(count);
+		_data.resize(count);
+		for (std::size_t i = 0; i < _entries; ++i) {
+			std::size_t h = _small[i].template hash< Hash >(_small[i].value());
+			std::size_t t = _index(h);
+			while (_data[t].occupied())
+				t = t + 1 == count ? 0 : t + 1;
+			_data[t] = std::move(_small[i].value());
+			_data[t].store(h);
+			_small[i].clear();
+		}
+		return { _data.last_resize_bytes(), std::chrono::steady_clock::now() - start };
+	}
+
+	template < typename F >
+	void _batched(const Key* keys, std::size_t n, F&& f) const {
+		if (_is_small()) {
+			for (std::size_t i = 0; i < n; ++i)
+				f(i, _hash(keys[i]), 0);
+			return;
+		}
+		std::size_t hash[_batch], pos[_batch];
+		for (std::size_t s = 0; s < n; s += _batch) {
+			std::size_t m = std::min(_batch, n - s);
+			for (std::size_t i = 0; i < m; ++i) {
+				hash[i] = Hash()(keys[s + i]);
+				pos[i] = _index(hash[i]);
+				__builtin_prefetch(&_data[pos[i]]);
+			}
+			for (std::size_t i = 0; i < m; ++i)
+				f(s + i, hash[i], pos[i]);
+		}
+	}
+
+	/* bucket holding k, whose hash is h, when probing from bucket b;
+	 * bucket_count() if none */
+	std::size_t _find(const Key& k, std::size_t h, std::size_t b) const {
+		if (_is_small()) {
+			for (std::size_t i = 0; i < _entries; ++i) {
+				if (_small[i].may_equal(h) && KeyEqual()(k, _small[i].value()))
+					return i;
+			}
+			return Inline;
+		}
+		for (std::size_t i = 0; i < bucket_count(); ++i, ++b) {
+			if (b == bucket_count())
+				b = 0;
+			if (_data[b].empty())
+				break;
+			if (_data[b].occupied() && _data[b].may_equal(h) && KeyEqual()(k, _data[b].value()))
+				return b;
+		}
+		return bucket_count();
+	}
+
+	const_iterator _at(std::size_t b) const {
+		if (_is_small())
+			return const_iterator(_small.data() + b, _small.data() + Inline);
+		return const_iterator(_data.begin() + b, _data.end());
+	}
+
+	iterator _at(std::size_t b) {
+		if (_is_small())
+			return iterator(_small.data() + b, _small.data() + Inline);
+		return iterator(_data.begin() + b, _data.end());
+	}
+
+	/* settles the key in bucket i, if it is moving, within the first
+	 * `count` buckets */
+	void _settle(std::size_t i, std::size_t count) {
+		while (_data[i].moving()) {
+			std::size_t h = _data[i].template hash< Hash >(_data[i].value());
+			std::size_t t = _index(h);
+			while (_data[t].occupied())
+				t = t + 1 == count ? 0 : t + 1;
+			if (t == i) {
+				_data[i].settle();
+			} else if (_data[t].empty()) {
+				_data[t] = std::move(_data[i].value());
+				_data[t].store(h);
+				_data[i].clear();
+			} else {
+				using std::swap;
+				swap(_data[t].value(), _data[i].value());
+				swap(static_cast< hash_base& >(_data[t]), static_cast< hash_base& >(_data[i]));
+				_data[t].settle();
+			}
+		}
+	}
 
 	template < typename _K >
 	bool _insert(_K&& k) {
-		auto it = _data.begin() + Hash()(k) % bucket_count();
+		std::size_t h = _hash(k);
+		return _insert(std::forward< _K >(k), h, _index(h));
+	}
+
+	template < typename _K >
+	bool _insert(_K&& k, std::size_t h, std::size_t pos) {
+		if (_find(k, h, pos) != bucket_count())
+			return false;
+		if (_is_small()) {
+			if (_entries < Inline) {
+				_small[_entries] = std::forward< _K >(k);
+				_small[_entries].store(h);
+				++_entries;
+				return true;
+			}
+			reserve(Inline + 1);
+			/* the inline scan may have been handed no hash, see _hash */
+			if (!StoreHash)
+				h = Hash()(k);
+			pos = _index(h);
+		}
+		auto it = _data.begin() + pos;
 		for (std::size_t i = 0; i < bucket_count() ; ++it, ++i) {
 			if (it == _data.end())
 				it = _data.begin();
 			if (!it->occupied()) {
+				if (it->zombie())
+					--_zombies;
 				*it = std::forward< _K >(k);
+				it->store(h);
 				++_entries;
-				while (load_factor() > _ml_factor) {
-					rehash(2 * bucket_count());
+				/* zombies lengthen probes as much as keys do; when they are
+				 * the bigger part, clean up instead of growing */
+				while (float(_entries + _zombies) / bucket_count() > _ml_factor) {
+					if (_zombies > _entries)
+						compact();
+					else
+						rehash(2 * bucket_count());
 				}
 				return true;
 			}
-			if (KeyEqual()(k, it->value()))
-				return false;
 		}
 		throw std::logic_error("invalid hash_table");
 	}
 
 	float _ml_factor;
 	vector _data;
+	Index _index;
 	std::size_t _entries = 0;
+	std::size_t _zombies = 0;
+	std::array< bucket, Inline > _small;
 };
@@ -6,13 +6,27 @@
 #include <brick-benchmark>
 #include <cmath>
 #include <cstdlib>
+#include <mutex>
 #include <random>
 #include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <type_traits>
+#include <utility>
 
 #include "chained_hash_table.hpp"
 #include "linear_probing_hash_table.hpp"
+#include "group_probing_hash_table.hpp"
+#include "robin_hood_hash_table.hpp"
+#include "pooled_chained_hash_table.hpp"
+#include "concurrent_hash_set.hpp"
+#include "chained_hash_map.hpp"
+#include "linear_probing_hash_map.hpp"
+#include "hash_snapshot.hpp"
+#include "cuckoo_hash_table.hpp"
 
 using namespace brick;
 using T = int;
@@ -20,6 +34,33 @@ using set = std::set< T >;
 using uset = std::unordered_set< T >;
 using cht = chained_hash_table< T >;
 using pht = linear_probing_hash_table< T >;
+using gpt = group_probing_hash_table< T >;
+using rht = robin_hood_hash_table< T >;
+using ckt = cuckoo_hash_table< T >;
+using pct = pooled_chained_hash_table< T >;
+using umap = std::unordered_map< T, T >;
+using chm = chained_hash_map< T, T >;
+using phm = linear_probing_hash_map< T, T >;
+
+using str = std::string;
+using suset = std::unordered_set< str >;
+using scht = chained_hash_table< str >;
+using scht_h = chained_hash_table< str, std::hash< str >, std::equal_to< str >, modulo_index, true >;
+using spht = linear_probing_hash_table< str >;
+using spht_h = linear_probing_hash_table< str, std::hash< str >, std::equal_to< str >, modulo_index, true >;
+
+template < typename C >
+constexpr bool is_string_set = std::is_same< C, suset >::value || std::is_same< C, scht >::value
+		|| std::is_same< C, scht_h >::value || std::is_same< C, spht >::value || std::is_same< C, spht_h >::value;
+
+template < typename C >
+constexpr bool is_map = std::is_same< C, umap >::value || std::is_same< C, chm >::value
+		|| std::is_same< C, phm >::value;
+
+template < typename I >
+using cht_with = chained_hash_table< T, std::hash< T >, std::equal_to< T >, I >;
+template < typename I >
+using pht_with = linear_probing_hash_table< T, std::hash< T >, std::equal_to< T >, I >;
 
 struct hw2 : benchmark::Group {
 	hw2() {
@@ -33,28 +74,68 @@ struct hw2 : benchmark::Group {
 		y.type = benchmark::Axis::Qualitative;
 		y.name = "implementation";
 		y.min = 1;
-        y.max = 4;
+        y.max = 24;
         y._render = [](int i) {
             switch (i) {
             case 1: return "unordered_set";
             case 2: return "hash_table(chaining)";
 			case 3: return "hash_table(linear probing)";
 			case 4: return "set";
+			case 5: return "hash_table(group probing)";
+			case 6: return "hash_table(robin hood)";
+			case 7: return "hash_table(chaining, mask)";
+			case 8: return "hash_table(chaining, fibonacci)";
+			case 9: return "hash_table(chaining, prime)";
+			case 10: return "hash_table(linear probing, mask)";
+			case 11: return "hash_table(linear probing, fibonacci)";
+			case 12: return "hash_table(linear probing, prime)";
+			case 13: return "hash_table(pooled chaining)";
+			case 14: return "unordered_map";
+			case 15: return "hash_map(chaining)";
+			case 16: return "hash_map(linear probing)";
+			case 17: return "unordered_set<string>";
+			case 18: return "hash_table<string>(chaining)";
+			case 19: return "hash_table<string>(chaining, stored hash)";
+			case 20: return "hash_table<string>(linear probing)";
+			case 21: return "hash_table<string>(linear probing, stored hash)";
+			case 22: return "hash_table(chaining, range constructor)";
+			case 23: return "hash_table(linear probing, range constructor)";
+			case 24: return "hash_table(cuckoo)";
             }
         };
+
+		/* long shared prefixes make every KeyEqual call expensive */
+		for (int i = 0; i <= 2 * x.max; ++i)
+			_names.push_back(str(24, 'k') + std::to_string(i));
 	}
 
 	template < typename C >
 	void _insert() const {
 		C con;
-		if constexpr (std::is_same< C, uset >::value || std::is_same< C, pht >::value) {
+		if constexpr (std::is_same< C, uset >::value || std::is_same< C, pht >::value
+				|| std::is_same< C, umap >::value || std::is_same< C, phm >::value
+				|| std::is_same< C, suset >::value || std::is_same< C, spht >::value
+				|| std::is_same< C, spht_h >::value) {
 			con.max_load_factor(2.0f/3.0f);
 		}
-		for (int i = 0; i < p; ++i)
+		for (int i = 0; i < p; ++i) {
+			if constexpr (is_map< C >)
+				con.try_emplace(_data[i], _data[i]);
+			else if constexpr (is_string_set< C >)
+				con.insert(_names[_data[i]]);
+			else
 				con.insert(_data[i]);
+		}
+	}
+
+	/* sized once up front instead of growing through every bucket count */
+	template < typename C >
+	void _construct() const {
+		C con(_data.begin(), _data.end());
 	}
 
 	std::vector< T > _data;
+	std::vector< str > _names;
 };
 
 struct insert : hw2 {
@@ -64,6 +145,26 @@ struct insert : hw2 {
 		case 2: _insert< cht >(); break;
 		case 3: _insert< pht >(); break;
 		case 4: _insert< set >(); break;
+		case 5: _insert< gpt >(); break;
+		case 6: _insert< rht >(); break;
+		case 7: _insert< cht_with< mask_index > >(); break;
+		case 8: _insert< cht_with< fibonacci_index > >(); break;
+		case 9: _insert< cht_with< prime_index > >(); break;
+		case 10: _insert< pht_with< mask_index > >(); break;
+		case 11: _insert< pht_with< fibonacci_index > >(); break;
+		case 12: _insert< pht_with< prime_index > >(); break;
+		case 13: _insert< pct >(); break;
+		case 14: _insert< umap >(); break;
+		case 15: _insert< chm >(); break;
+		case 16: _insert< phm >(); break;
+		case 17: _insert< suset >(); break;
+		case 18: _insert< scht >(); break;
+		case 19: _insert< scht_h >(); break;
+		case 20: _insert< spht >(); break;
+		case 21: _insert< spht_h >(); break;
+		case 22: _construct< cht >(); break;
+		case 23: _construct< pht >(); break;
+		case 24: _insert< ckt >(); break;
        	}
 	}
 
@@ -74,6 +175,26 @@ struct insert : hw2 {
 		case 2: _insert< cht >(); break;
 		case 3: _insert< pht >(); break;
 		case 4: _insert< set >(); break;
+		case 5: _insert< gpt >(); break;
+		case 6: _insert< rht >(); break;
+		case 7: _insert< cht_with< mask_index > >(); break;
+		case 8: _insert< cht_with< fibonacci_index > >(); break;
+		case 9: _insert< cht_with< prime_index > >(); break;
+		case 10: _insert< pht_with< mask_index > >(); break;
+		case 11: _insert< pht_with< fibonacci_index > >(); break;
+		case 12: _insert< pht_with< prime_index > >(); break;
+		case 13: _insert< pct >(); break;
+		case 14: _insert< umap >(); break;
+		case 15: _insert< chm >(); break;
+		case 16: _insert< phm >(); break;
+		case 17: _insert< suset >(); break;
+		case 18: _insert< scht >(); break;
+		case 19: _insert< scht_h >(); break;
+		case 20: _insert< spht >(); break;
+		case 21: _insert< spht_h >(); break;
+		case 22: _construct< cht >(); break;
+		case 23: _construct< pht >(); break;
+		case 24: _insert< ckt >(); break;
        	}
 	}
 
@@ -103,6 +224,26 @@ struct erase : hw2 {
 		case 2: _p.erase(mt() % p); break;
 		case 3: _c.erase(mt() % p); break;
 		case 4: _s.erase(mt() % p); break;
+		case 5: _g.erase(mt() % p); break;
+		case 6: _r.erase(mt() % p); break;
+		case 7: _cm.erase(mt() % p); break;
+		case 8: _cf.erase(mt() % p); break;
+		case 9: _cp.erase(mt() % p); break;
+		case 10: _pm.erase(mt() % p); break;
+		case 11: _pf.erase(mt() % p); break;
+		case 12: _pp.erase(mt() % p); break;
+		case 13: _pc.erase(mt() % p); break;
+		case 14: _um.erase(mt() % p); break;
+		case 15: _ch.erase(mt() % p); break;
+		case 16: _ph.erase(mt() % p); break;
+		case 17: _su.erase(_names[mt() % p]); break;
+		case 18: _sc.erase(_names[mt() % p]); break;
+		case 19: _sch.erase(_names[mt() % p]); break;
+		case 20: _sp.erase(_names[mt() % p]); break;
+		case 21: _sph.erase(_names[mt() % p]); break;
+		case 22: _cr.erase(mt() % p); break;
+		case 23: _pr.erase(mt() % p); break;
+		case 24: _ck.erase(mt() % p); break;
 		}
 	}
 
@@ -113,19 +254,61 @@ struct erase : hw2 {
 		std::default_random_engine e(r());
 		std::uniform_int_distribution< T > uid(0, x.max);
 		
+		_data.clear();
 		for (int i = 0; i < p; ++i) {
 			auto x = uid(e);
 			_u.insert(x);
 			_p.insert(x);
 			_c.insert(x);
 			_s.insert(x);
-		}		
+			_g.insert(x);
+			_r.insert(x);
+			_cm.insert(x);
+			_cf.insert(x);
+			_cp.insert(x);
+			_pm.insert(x);
+			_pf.insert(x);
+			_pp.insert(x);
+			_pc.insert(x);
+			_um.try_emplace(x, x);
+			_ch.try_emplace(x, x);
+			_ph.try_emplace(x, x);
+			_su.insert(_names[x]);
+			_sc.insert(_names[x]);
+			_sch.insert(_names[x]);
+			_sp.insert(_names[x]);
+			_sph.insert(_names[x]);
+			_ck.insert(x);
+			_data.push_back(x);
+		}
+		_cr = cht(_data.begin(), _data.end());
+		_pr = pht(_data.begin(), _data.end());		
 	}
 
 	uset _u;
 	pht _p;
 	cht _c;
 	set _s;
+	gpt _g;
+	rht _r;
+	cht_with< mask_index > _cm;
+	cht_with< fibonacci_index > _cf;
+	cht_with< prime_index > _cp;
+	pht_with< mask_index > _pm;
+	pht_with< fibonacci_index > _pf;
+	pht_with< prime_index > _pp;
+	pct _pc;
+	umap _um;
+	chm _ch;
+	phm _ph;
+	suset _su;
+	scht _sc;
+	scht_h _sch;
+	spht _sp;
+	spht_h _sph;
+	cht _cr;
+	pht _pr;
+	ckt _ck;
 };
 
 struct find : hw2 {
@@ -137,6 +320,26 @@ struct find : hw2 {
 		case 2: _p.find(s()); break;
 		case 3: _c.find(s()); break;
 		case 4: _s.find(s()); break;
+		case 5: _g.find(s()); break;
+		case 6: _r.find(s()); break;
+		case 7: _cm.find(s()); break;
+		case 8: _cf.find(s()); break;
+		case 9: _cp.find(s()); break;
+		case 10: _pm.find(s()); break;
+		case 11: _pf.find(s()); break;
+		case 12: _pp.find(s()); break;
+		case 13: _pc.find(s()); break;
+		case 14: _um.find(s()); break;
+		case 15: _ch.find(s()); break;
+		case 16: _ph.find(s()); break;
+		case 17: _su.find(_names[s() % _names.size()]); break;
+		case 18: _sc.find(_names[s() % _names.size()]); break;
+		case 19: _sch.find(_names[s() % _names.size()]); break;
+		case 20: _sp.find(_names[s() % _names.size()]); break;
+		case 21: _sph.find(_names[s() % _names.size()]); break;
+		case 22: _cr.find(s()); break;
+		case 23: _pr.find(s()); break;
+		case 24: _ck.find(s()); break;
 		}
 	}
 
@@ -147,11 +350,29 @@ struct find : hw2 {
 		std::default_random_engine e(r());
 		std::uniform_int_distribution< T > uid(0, x.max);
 
-		_data.resize(p);
+		_data.clear();
 		_u = uset();
 		_p = pht();
 		_c = cht();
 		_s = set();
+		_g = gpt();
+		_r = rht();
+		_cm = {};
+		_cf = {};
+		_cp = {};
+		_pm = {};
+		_pf = {};
+		_pp = {};
+		_pc = pct();
+		_um = umap();
+		_ch = chm();
+		_ph = phm();
+		_su = suset();
+		_sc = scht();
+		_sch = scht_h();
+		_sp = spht();
+		_sph = spht_h();
+		_ck = ckt();
 		
 		for (int i = 0; i < p; ++i) {
 			auto x = uid(e);
@@ -159,13 +380,491 @@ struct find : hw2 {
 			_p.insert(x);
 			_c.insert(x);
 			_s.insert(x);
-		}		
+			_g.insert(x);
+			_r.insert(x);
+			_cm.insert(x);
+			_cf.insert(x);
+			_cp.insert(x);
+			_pm.insert(x);
+			_pf.insert(x);
+			_pp.insert(x);
+			_pc.insert(x);
+			_um.try_emplace(x, x);
+			_ch.try_emplace(x, x);
+			_ph.try_emplace(x, x);
+			_su.insert(_names[x]);
+			_sc.insert(_names[x]);
+			_sch.insert(_names[x]);
+			_sp.insert(_names[x]);
+			_sph.insert(_names[x]);
+			_ck.insert(x);
+			_data.push_back(x);
+		}
+		_cr = cht(_data.begin(), _data.end());
+		_pr = pht(_data.begin(), _data.end());		
 	}
 	
 	uset _u;
 	pht _p;
 	cht _c;
 	set _s;
+	gpt _g;
+	rht _r;
+	cht_with< mask_index > _cm;
+	cht_with< fibonacci_index > _cf;
+	cht_with< prime_index > _cp;
+	pht_with< mask_index > _pm;
+	pht_with< fibonacci_index > _pf;
+	pht_with< prime_index > _pp;
+	pct _pc;
+	umap _um;
+	chm _ch;
+	phm _ph;
+	suset _su;
+	scht _sc;
+	scht_h _sch;
+	spht _sp;
+	spht_h _sph;
+	cht _cr;
+	pht _pr;
+	ckt _ck;
+};
+
+/* many tiny tables, the common case the inline mode is meant for */
+struct small : benchmark::Group {
+	small() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "items per table";
+		x.min = 1;
+		x.max = 32;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 5;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "unordered_set";
+			case 2: return "hash_table(chaining)";
+			case 3: return "hash_table(chaining, 16 inline)";
+			case 4: return "hash_table(linear probing)";
+			case 5: return "hash_table(linear probing, 16 inline)";
+			}
+		};
+	}
+
+	static constexpr int tables = 1000;
+
+	BENCHMARK(insert_find) {
+		switch (q) {
+		case 1: _fill< uset >(); break;
+		case 2: _fill< cht >(); break;
+		case 3: _fill< chained_hash_table< T, std::hash< T >, std::equal_to< T >, modulo_index, false, 16 > >(); break;
+		case 4: _fill< pht >(); break;
+		case 5: _fill< linear_probing_hash_table< T, std::hash< T >, std::equal_to< T >, modulo_index, false, 16 > >(); break;
+		}
+	}
+
+	template < typename C >
+	void _fill() const {
+		std::vector< C > v(tables);
+		for (int t = 0; t < tables; ++t) {
+			for (int i = 0; i < p; ++i)
+				v[t].insert(t + i);
+			for (int i = 0; i < p; ++i)
+				v[t].find(t + i);
+		}
+	}
+};
+
+/* startup from a snapshot under /tmp against rebuilding the table, and
+ * lookups in both */
+struct snapshot : benchmark::Group {
+	snapshot() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "items";
+		x.min = 10000;
+		x.max = 10000000;
+		x.log = true;
+		x.step = 10;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 2;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "hash_table(linear probing)";
+			case 2: return "mapped_hash_set";
+			}
+		};
+	}
+
+	static constexpr std::size_t lookups = 4096;
+
+	~snapshot() {
+		unlink(_path.c_str());
+	}
+
+	void setup(int _pt, int _q) override {
+		p = _pt; q = _q;
+		std::mt19937 e(p);
+		std::uniform_int_distribution< T > uid(0, 2 * p);
+		_keys.resize(p);
+		for (auto& k : _keys)
+			k = uid(e);
+		_t = pht(_keys.begin(), _keys.end());
+		write_snapshot(_path, _t);
+		_m = mapped_hash_set< T >::open(_path);
+	}
+
+	/* ready to answer the first lookup */
+	BENCHMARK(startup) {
+		switch (q) {
+		case 1: {
+			pht t(_keys.begin(), _keys.end());
+			t.find(_keys[0]);
+			break;
+		}
+		case 2: {
+			auto m = mapped_hash_set< T >::open(_path);
+			m.find(_keys[0]);
+			break;
+		}
+		}
+	}
+
+	BENCHMARK(lookup) {
+		for (std::size_t i = 0; i < lookups; ++i) {
+			switch (q) {
+			case 1: _t.find(_keys[(i * 7919) % _keys.size()]); break;
+			case 2: _m.find(_keys[(i * 7919) % _keys.size()]); break;
+			}
+		}
+	}
+
+	/* a file of its own, so that parallel runs do not share it */
+	static std::string _unique_path() {
+		char name[] = "/tmp/hash_snapshot.XXXXXX";
+		int fd = mkstemp(name);
+		if (fd < 0)
+			throw std::runtime_error("cannot create a snapshot file");
+		close(fd);
+		return name;
+	}
+
+	std::string _path = _unique_path();
+	std::vector< T > _keys;
+	pht _t;
+	mapped_hash_set< T > _m;
+};
+
+/* lookups in tables of a fixed 65536 slots filled up to a given load
+ * factor; probing tables are allowed to go as high as cuckoo hashing.
+ * 96% stays below the ~98% where four-slot buckets start to fail. */
+struct high_load : benchmark::Group {
+	high_load() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "load factor (%)";
+		x.min = 60;
+		x.max = 96;
+		x.log = false;
+		x.step = 4;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 5;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "hash_table(linear probing)";
+			case 2: return "hash_table(robin hood)";
+			case 3: return "hash_table(group probing)";
+			case 4: return "hash_table(cuckoo)";
+			case 5: return "hash_table(cuckoo, 8 slots)";
+			}
+		};
+	}
+
+	static constexpr std::size_t capacity = 1 << 16;
+	static constexpr std::size_t lookups = 4096;
+
+	using ckt8 = cuckoo_hash_table< T, std::hash< T >, std::equal_to< T >, 8 >;
+
+	void setup(int _pt, int _q) override {
+		p = _pt; q = _q;
+		std::mt19937 e(p);
+		uset keys;
+		_hits.clear();
+		_misses.clear();
+		while (_hits.size() < capacity * p / 100) {
+			T k = e();
+			if (keys.insert(k).second)
+				_hits.push_back(k);
+		}
+		while (_misses.size() < lookups) {
+			T k = e();
+			if (!keys.count(k))
+				_misses.push_back(k);
+		}
+		switch (q) {
+		case 1: _fill(_p); break;
+		case 2: _fill(_r); break;
+		case 3: _fill(_g); break;
+		case 4: _fill(_c); break;
+		case 5: _fill(_c8); break;
+		}
+	}
+
+	BENCHMARK(find_hit) {
+		_find(_hits);
+	}
+
+	/* the longest probes, every one runs to its end */
+	BENCHMARK(find_miss) {
+		_find(_misses);
+	}
+
+	template < typename C >
+	void _fill(C& t) {
+		t = C();
+		t.max_load_factor(0.99f);
+		t.rehash(capacity);
+		for (T k : _hits)
+			t.insert(k);
+		/* a table that grew would be measured under the wrong load */
+		if (t.bucket_count() != capacity)
+			throw std::logic_error("table did not hold the load factor");
+	}
+
+	void _find(const std::vector< T >& keys) const {
+		for (std::size_t i = 0; i < lookups; ++i) {
+			T k = keys[(i * 7919) % keys.size()];
+			switch (q) {
+			case 1: _p.find(k); break;
+			case 2: _r.find(k); break;
+			case 3: _g.find(k); break;
+			case 4: _c.find(k); break;
+			case 5: _c8.find(k); break;
+			}
+		}
+	}
+
+	std::vector< T > _hits;
+	std::vector< T > _misses;
+	pht _p;
+	rht _r;
+	gpt _g;
+	ckt _c;
+	ckt8 _c8;
+};
+
+/* growing and shrinking in place, toggling between two bucket counts */
+struct resize : benchmark::Group {
+	resize() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "items";
+		x.min = 10000;
+		x.max = 1000000;
+		x.log = true;
+		x.step = 10;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "hash_table(chaining) rehash";
+			case 2: return "hash_table(linear probing) rehash";
+			case 3: return "hash_table(linear probing) erase + compact";
+			}
+		};
+	}
+
+	void setup(int _pt, int _q) override {
+		p = _pt; q = _q;
+		_p = pht();
+		_c = cht();
+		for (int i = 0; i < p; ++i) {
+			_p.insert(i);
+			_c.insert(i);
+		}
+	}
+
+	BENCHMARK(rehash) {
+		switch (q) {
+		case 1: _c.rehash(_c.size() % 2 ? _c.size() - 1 : _c.size() + 1); break;
+		case 2: _p.rehash(_p.bucket_count() % 2 ? _p.bucket_count() - 1 : _p.bucket_count() + 1); break;
+		case 3:
+			/* a fresh quarter of zombies to purge every time */
+			for (int i = 0; i < p; i += 4)
+				_p.erase(i);
+			_p.compact();
+			for (int i = 0; i < p; i += 4)
+				_p.insert(i);
+			break;
+		}
+	}
+
+	pht _p;
+	cht _c;
+};
+
+struct batch : benchmark::Group {
+	batch() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "items";
+		x.min = 10000;
+		x.max = 10000000;
+		x.log = true;
+		x.step = 10;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 6;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "hash_table(chaining) find loop";
+			case 2: return "hash_table(chaining) find_many";
+			case 3: return "hash_table(linear probing) find loop";
+			case 4: return "hash_table(linear probing) find_many";
+			case 5: return "hash_table(chaining) insert_many";
+			case 6: return "hash_table(linear probing) insert_many";
+			}
+		};
+	}
+
+	static constexpr std::size_t lookups = 4096;
+
+	void setup(int _pt, int _q) override {
+		p = _pt; q = _q;
+		std::mt19937 e(p);
+		std::uniform_int_distribution< T > uid(0, 2 * p);
+		_p = pht();
+		_c = cht();
+		for (int i = 0; i < p; ++i) {
+			T k = uid(e);
+			_p.insert(k);
+			_c.insert(k);
+		}
+		_keys.clear();
+		for (std::size_t i = 0; i < lookups; ++i)
+			_keys.push_back(uid(e));
+	}
+
+	BENCHMARK(lookup) {
+		switch (q) {
+		case 1:
+			for (std::size_t i = 0; i < lookups; ++i)
+				_cres[i] = std::as_const(_c).find(_keys[i]);
+			break;
+		case 2: _c.find_many(_keys.data(), lookups, _cres); break;
+		case 3:
+			for (std::size_t i = 0; i < lookups; ++i)
+				_pres[i] = std::as_const(_p).find(_keys[i]);
+			break;
+		case 4: _p.find_many(_keys.data(), lookups, _pres); break;
+		/* the keys are mostly present already, so these are lookups too */
+		case 5: _c.insert_many(_keys.data(), lookups); break;
+		case 6: _p.insert_many(_keys.data(), lookups); break;
+		}
+	}
+
+	pht _p;
+	cht _c;
+	std::vector< T > _keys;
+	cht::const_iterator _cres[lookups];
+	pht::const_iterator _pres[lookups];
+};
+
+struct concurrent : benchmark::Group {
+	concurrent() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "threads";
+		x.min = 1;
+		x.max = 16;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 6;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "unordered_set + mutex, 90% reads";
+			case 2: return "concurrent_hash_set, 90% reads";
+			case 3: return "unordered_set + mutex, 50% reads";
+			case 4: return "concurrent_hash_set, 50% reads";
+			case 5: return "unordered_set + mutex, 10% reads";
+			case 6: return "concurrent_hash_set, 10% reads";
+			}
+		};
+	}
+
+	static constexpr int keys = 1 << 16;
+	static constexpr int ops = 1 << 19;
+
+	void setup(int _pt, int _q) override {
+		p = _pt; q = _q;
+		_u = uset();
+		_c = std::make_unique< concurrent_hash_set< T > >();
+		for (int i = 0; i < keys; i += 2) {
+			_u.insert(i);
+			_c->insert(i);
+		}
+	}
+
+	/* the same total number of operations split over p threads; the rest
+	 * of the operations alternate between insert and erase */
+	BENCHMARK(throughput) {
+		int reads = q <= 2 ? 9 : q <= 4 ? 5 : 1;
+		std::vector< std::thread > threads;
+		for (int t = 0; t < p; ++t) {
+			threads.emplace_back([this, t, reads] {
+				std::mt19937 e(t);
+				std::uniform_int_distribution< int > uid(0, keys - 1);
+				int writes = 0;
+				for (int i = 0; i < ops / p; ++i) {
+					int k = uid(e);
+					/* the write kind has its own counter: with i % 2 the write
+					 * slots of a 90% mix would all be erases */
+					int op = i % 10 < reads ? 0 : 1 + writes++ % 2;
+					if (q % 2)
+						_locked(op, k);
+					else
+						_lockfree(op, k);
+				}
+			});
+		}
+		for (auto& t : threads)
+			t.join();
+	}
+
+	void _locked(int op, int k) {
+		std::lock_guard< std::mutex > l(_m);
+		switch (op) {
+		case 0: _u.count(k); break;
+		case 1: _u.insert(k); break;
+		case 2: _u.erase(k); break;
+		}
+	}
+
+	void _lockfree(int op, int k) {
+		switch (op) {
+		case 0: _c->contains(k); break;
+		case 1: _c->insert(k); break;
+		case 2: _c->erase(k); break;
+		}
+	}
+
+	std::mutex _m;
+	uset _u;
+	std::unique_ptr< concurrent_hash_set< T > > _c;
 };
 
 #include <queue>
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "index_policy.hpp"
+
+/* Hands out storage for T from blocks that double in size, and keeps freed
+ * slots on an intrusive free list for reuse. Objects are constructed and
+ * destroyed by the user; the pool only frees whole blocks. */
+template < typename T >
+class node_pool {
+	union slot {
+		slot* next;
+		alignas(T) unsigned char storage[sizeof(T)];
+	};
+
+public:
+	node_pool() = default;
+	node_pool(const node_pool&) = delete;
+	node_pool& operator=(const node_pool&) = delete;
+
+	node_pool(node_pool&& p) noexcept {
+		swap(p);
+	}
+
+	node_pool& operator=(node_pool&& p) noexcept {
+		swap(p);
+		return *this;
+	}
+
+	void* allocate() {
+		if (_free) {
+			slot* s = _free;
+			_free = s->next;
+			return s->storage;
+		}
+		if (_used == _block_size) {
+			_block_size = _blocks.empty() ? 16 : 2 * _block_size;
+			_blocks.emplace_back(new slot[_block_size]);
+			_used = 0;
+		}
+		return _blocks.back()[_used++].storage;
+	}
+
+	void deallocate(void* p) noexcept {
+		slot* s = reinterpret_cast< slot* >(p);
+		s->next = _free;
+		_free = s;
+	}
+
+	void swap(node_pool& p) noexcept {
+		std::swap(_blocks, p._blocks);
+		std::swap(_free, p._free);
+		std::swap(_block_size, p._block_size);
+		std::swap(_used, p._used);
+	}
+
+private:
+	std::vector< std::unique_ptr< slot[] > > _blocks;
+	slot* _free = nullptr;
+	std::size_t _block_size = 0;
+	std::size_t _used = 0;
+};
+
+/* Separate chaining with singly-linked nodes carved out of a node_pool: one
+ * pointer of overhead per key, no allocator call per insert once the pool
+ * has grown, and erased nodes are recycled. The bucket array holds only the
+ * chain heads, so a rehash allocates a new array of pointers and relinks
+ * the nodes; keys are never moved. */
+template < typename Key, typename Hash = std::hash< Key >, typename KeyEqual = std::equal_to< Key >,
+		typename Index = modulo_index >
+class pooled_chained_hash_table {
+	struct node {
+		node* next;
+		Key key;
+	};
+
+	using vector = std::vector< node* >;
+
+	struct _iterator {
+	protected:
+		const node* const* _s = nullptr;
+		const node* const* _e = nullptr;
+		const node* _c = nullptr;
+
+	public:
+		_iterator() = default;
+		_iterator(const node* const* s, const node* const* e)
+				: _s(s), _e(e) {
+			while (_s != _e && !*_s)
+				++_s;
+			if (_s != _e)
+				_c = *_s;
+		}
+
+		_iterator(const node* const* s, const node* const* e, const node* c)
+				: _s(s), _e(e), _c(c) {}
+
+		const Key& operator*() const noexcept {
+			return _c->key;
+		}
+
+		const Key* operator->() const noexcept {
+			return std::addressof(_c->key);
+		}
+
+		_iterator& operator++() noexcept {
+			if (!(_c = _c->next)) {
+				do {
+					++_s;
+				} while (_s != _e && !*_s);
+				if (_s != _e)
+					_c = *_s;
+			}
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _s == i._s && _c == i._c;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+	};
+public:
+	using iterator = _iterator;
+	using const_iterator = _iterator;
+
+	pooled_chained_hash_table()
+			: _ml_factor(10),
+			  _data(Index().round(1), nullptr) {
+		_index.reset(size());
+	}
+
+	pooled_chained_hash_table(const pooled_chained_hash_table& t)
+			: pooled_chained_hash_table() {
+		_ml_factor = t._ml_factor;
+		rehash(t.size());
+		for (const auto& k : t)
+			insert(k);
+	}
+
+	/* leaves t empty, as if default constructed */
+	pooled_chained_hash_table(pooled_chained_hash_table&& t) noexcept
+			: pooled_chained_hash_table() {
+		_swap(t);
+	}
+
+	pooled_chained_hash_table& operator=(pooled_chained_hash_table t) noexcept {
+		_swap(t);
+		return *this;
+	}
+
+	~pooled_chained_hash_table() {
+		for (node* n : _data) {
+			while (n) {
+				node* next = n->next;
+				n->~node();
+				n = next;
+			}
+		}
+	}
+
+	void rehash(std::size_t count) {
+		count = _index.round(count);
+		vector tmp(count, nullptr);
+		_index.reset(count);
+		for (node* n : _data) {
+			while (n) {
+				node* next = n->next;
+				node*& head = tmp[_index(Hash()(n->key))];
+				n->next = head;
+				head = n;
+				n = next;
+			}
+		}
+		_data = std::move(tmp);
+	}
+
+	const_iterator find(const Key& k) const {
+		std::size_t b = _index(Hash()(k));
+		for (const node* n = _data[b]; n; n = n->next) {
+			if (KeyEqual()(n->key, k))
+				return const_iterator(_data.data() + b, _data.data() + size(), n);
+		}
+		return end();
+	}
+
+	bool erase(const Key& k) {
+		for (node** n = &_data[_index(Hash()(k))]; *n; n = &(*n)->next) {
+			if (KeyEqual()((*n)->key, k)) {
+				node* dead = *n;
+				*n = dead->next;
+				dead->~node();
+				_pool.deallocate(dead);
+				--_entries;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool insert(const Key& k) {
+		return _insert(k);
+	}
+
+	bool insert(Key&& k) {
+		return _insert(std::move(k));
+	}
+
+	std::size_t size() const noexcept {
+		return _data.size();
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / size();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(_data.data(), _data.data() + size());
+	}
+
+	const_iterator end() const {
+		return const_iterator(_data.data() + size(), _data.data() + size());
+	}
+
+private:
+	template < typename _K >
+	bool _insert(_K&& k) {
+		node*& head = _data[_index(Hash()(k))];
+		for (const node* n = head; n; n = n->next) {
+			if (KeyEqual()(k, n->key))
+				return false;
+		}
+		void* p = _pool.allocate();
+		try {
+			head = new (p) node{ head, std::forward< _K >(k) };
+		} catch (...) {
+			_pool.deallocate(p);
+			throw;
+		}
+		++_entries;
+		if (load_factor() > _ml_factor)
+			rehash(2 * size());
+		return true;
+	}
+
+	void _swap(pooled_chained_hash_table& t) noexcept {
+		std::swap(_ml_factor, t._ml_factor);
+		std::swap(_data, t._data);
+		std::swap(_index, t._index);
+		std::swap(_entries, t._entries);
+		_pool.swap(t._pool);
+	}
+
+	float _ml_factor = 10;
+	vector _data;
+	Index _index;
+	std::size_t _entries = 0;
+	node_pool< node > _pool;
+};
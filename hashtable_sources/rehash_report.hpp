@@ -0,0 +1,11 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+/* what a rehash or compact() cost: the most bytes the table's own arrays
+ * held at any point during it, and the wall-clock time it took */
+struct rehash_report {
+	std::size_t peak_bytes = 0;
+	std::chrono::nanoseconds time{};
+};
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+
+/* Linear probing where every bucket remembers how far it is from its home
+ * bucket. An insert that meets an entry closer to home than itself takes
+ * that bucket and carries on inserting the displaced entry, which keeps
+ * probe lengths even. Entries of one home bucket are then contiguous and
+ * ordered by distance, so a lookup stops at the first bucket whose distance
+ * is shorter than the probe so far. Erase shifts the following entries one
+ * bucket back until an empty bucket or an entry at home, so there are no
+ * tombstones and the table stays as if the key had never been inserted. */
+template < typename Key,
+		typename Hash = std::hash< Key >,
+		typename KeyEqual = std::equal_to< Key > >
+class robin_hood_hash_table {
+	struct bucket {
+		bucket() {}
+		~bucket() {}
+
+		/* 0 for an empty bucket, otherwise distance from home + 1 */
+		std::uint32_t dist = 0;
+		union {
+			Key key;
+		};
+	};
+
+	struct _iterator {
+	protected:
+		const bucket* _cur = nullptr;
+		const bucket* _end = nullptr;
+	public:
+		_iterator() = default;
+		_iterator(const bucket* c, const bucket* e)
+				: _cur(c), _end(e) {
+			while (_cur != _end && !_cur->dist)
+				++_cur;
+		}
+
+		const Key& operator*() const noexcept {
+			return _cur->key;
+		}
+
+		const Key* operator->() const noexcept {
+			return std::addressof(_cur->key);
+		}
+
+		_iterator& operator++() noexcept {
+			do {
+				++_cur;
+			} while (_cur != _end && !_cur->dist);
+			return *this;
+		}
+
+		_iterator operator++(int) noexcept {
+			auto cpy = *this;
+			++(*this);
+			return cpy;
+		}
+
+		bool operator==(const _iterator& i) const noexcept {
+			return _cur == i._cur;
+		}
+
+		bool operator!=(const _iterator& i) const noexcept {
+			return !(*this == i);
+		}
+	};
+public:
+	using iterator = _iterator;
+	using const_iterator = _iterator;
+
+	robin_hood_hash_table()
+			: _ml_factor(7.0f/8.0f),
+			  _data(new bucket[1]),
+			  _size(1) {}
+
+	robin_hood_hash_table(const robin_hood_hash_table& t)
+			: _ml_factor(t._ml_factor),
+			  _data(new bucket[t._size]),
+			  _size(t._size),
+			  _entries(t._entries) {
+		for (std::size_t i = 0; i < _size; ++i) {
+			if (t._data[i].dist) {
+				new (&_data[i].key) Key(t._data[i].key);
+				_data[i].dist = t._data[i].dist;
+			}
+		}
+	}
+
+	/* leaves t empty, as if default constructed */
+	robin_hood_hash_table(robin_hood_hash_table&& t) noexcept
+			: robin_hood_hash_table() {
+		_swap(t);
+	}
+
+	robin_hood_hash_table& operator=(robin_hood_hash_table t) noexcept {
+		_swap(t);
+		return *this;
+	}
+
+	~robin_hood_hash_table() {
+		_destroy();
+	}
+
+	void rehash(std::size_t count) {
+		if (count <= _entries)
+			count = _entries + 1;
+		std::unique_ptr< bucket[] > tmp(new bucket[count]);
+		std::swap(tmp, _data);
+		std::size_t old = _size;
+		_size = count;
+		_entries = 0;
+		for (std::size_t i = 0; i < old; ++i) {
+			if (tmp[i].dist) {
+				_place(std::move(tmp[i].key));
+				tmp[i].key.~Key();
+			}
+		}
+	}
+
+	bool insert(const Key& k) {
+		return _insert(k);
+	}
+
+	bool insert(Key&& k) {
+		return _insert(std::move(k));
+	}
+
+	const_iterator find(const Key& k) const {
+		std::size_t i = _find(k);
+		return i == _size ? end() : const_iterator(_data.get() + i, _data.get() + _size);
+	}
+
+	bool erase(const Key& k) {
+		std::size_t i = _find(k);
+		if (i == _size)
+			return false;
+		_data[i].key.~Key();
+		for (std::size_t j = _next(i); _data[j].dist > 1; i = j, j = _next(j)) {
+			new (&_data[i].key) Key(std::move(_data[j].key));
+			_data[i].dist = _data[j].dist - 1;
+			_data[j].key.~Key();
+		}
+		_data[i].dist = 0;
+		--_entries;
+		return true;
+	}
+
+	std::size_t bucket_count() const noexcept {
+		return _size;
+	}
+
+	float load_factor() const noexcept {
+		return float(_entries) / bucket_count();
+	}
+
+	void max_load_factor(float ml) noexcept {
+		_ml_factor = ml;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(_data.get(), _data.get() + _size);
+	}
+
+	const_iterator end() const {
+		return const_iterator(_data.get() + _size, _data.get() + _size);
+	}
+
+private:
+	std::size_t _next(std::size_t i) const noexcept {
+		return ++i == _size ? 0 : i;
+	}
+
+	/* index of k, or _size when it is not in the table */
+	std::size_t _find(const Key& k) const {
+		std::size_t i = Hash()(k) % _size;
+		for (std::uint32_t d = 1; _data[i].dist >= d; ++d, i = _next(i))
+			if (KeyEqual()(k, _data[i].key))
+				return i;
+		return _size;
+	}
+
+	/* inserts a key known not to be in the table */
+	void _place(Key k) {
+		std::size_t i = Hash()(k) % _size;
+		std::uint32_t d = 1;
+		for (; _data[i].dist; ++d, i = _next(i)) {
+			if (_data[i].dist < d) {
+				using std::swap;
+				swap(k, _data[i].key);
+				swap(d, _data[i].dist);
+			}
+		}
+		new (&_data[i].key) Key(std::move(k));
+		_data[i].dist = d;
+		++_entries;
+	}
+
+	template < typename _K >
+	bool _insert(_K&& k) {
+		if (_find(k) != _size)
+			return false;
+		/* one bucket always stays empty, which ends every probe */
+		if (_entries + 1 > _size * _ml_factor || _entries + 1 >= _size)
+			rehash(2 * _size);
+		_place(std::forward< _K >(k));
+		return true;
+	}
+
+	void _destroy() noexcept {
+		for (std::size_t i = 0; i < _size; ++i)
+			if (_data[i].dist)
+				_data[i].key.~Key();
+	}
+
+	void _swap(robin_hood_hash_table& t) noexcept {
+		std::swap(_ml_factor, t._ml_factor);
+		std::swap(_data, t._data);
+		std::swap(_size, t._size);
+		std::swap(_entries, t._entries);
+	}
+
+	float _ml_factor = 7.0f/8.0f;
+	std::unique_ptr< bucket[] > _data;
+	std::size_t _size = 0;
+	std::size_t _entries = 0;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+/* Base of a table entry that keeps, or does not keep, the hash of its key.
+ * With the hash stored, a rehash reads it instead of hashing the key again
+ * and probes compare it before calling KeyEqual; without it both fall back
+ * to the key and the base is empty. */
+template < bool Stored >
+struct stored_hash {
+	void store(std::size_t) noexcept {}
+
+	template < typename Hash, typename Key >
+	std::size_t hash(const Key& k) const {
+		return Hash()(k);
+	}
+
+	bool may_equal(std::size_t) const noexcept {
+		return true;
+	}
+};
+
+template <>
+struct stored_hash< true > {
+	void store(std::size_t h) noexcept {
+		_hash = h;
+	}
+
+	template < typename Hash, typename Key >
+	std::size_t hash(const Key&) const noexcept {
+		return _hash;
+	}
+
+	bool may_equal(std::size_t h) const noexcept {
+		return _hash == h;
+	}
+
+private:
+	std::size_t _hash = 0;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+/* std::allocator replacement returning storage aligned to `Align` bytes
+ * (a cache line by default), so rows can be read with aligned vector loads */
+template < typename T, std::size_t Align = 64 >
+struct aligned_allocator {
+	using value_type = T;
+
+	static constexpr std::size_t alignment = Align;
+
+	template < typename U >
+	struct rebind {
+		using other = aligned_allocator< U, Align >;
+	};
+
+	aligned_allocator() = default;
+
+	template < typename U >
+	aligned_allocator(const aligned_allocator< U, Align >&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		return static_cast< T* >(::operator new(n * sizeof(T), std::align_val_t(Align)));
+	}
+
+	void deallocate(T* p, std::size_t) noexcept {
+		::operator delete(p, std::align_val_t(Align));
+	}
+
+	template < typename U >
+	bool operator==(const aligned_allocator< U, Align >&) const noexcept {
+		return true;
+	}
+
+	template < typename U >
+	bool operator!=(const aligned_allocator< U, Align >&) const noexcept {
+		return false;
+	}
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include "block_profile.hpp"
+#include "matrix.hpp"
+
+/* Sweeps the block sizes of cache_mul and packed_mul one dimension at a
+ * time (the other two stay at the best value found so far) and keeps the
+ * fastest of each sweep. */
+namespace autotune {
+
+template < typename F >
+double measure(F&& f, unsigned repeat = 3) {
+	double best = std::numeric_limits< double >::max();
+	for (unsigned i = 0; i < repeat; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		f();
+		std::chrono::duration< double > d = std::chrono::steady_clock::now() - start;
+		best = std::min(best, d.count());
+	}
+	return best;
+}
+
+template < typename Run >
+void sweep(std::size_t& value, const std::vector< std::size_t >& candidates, Run&& run) {
+	double best = std::numeric_limits< double >::max();
+	std::size_t winner = value;
+	for (auto c : candidates) {
+		value = c;
+		double t = measure(run);
+		if (t < best) {
+			best = t;
+			winner = c;
+		}
+	}
+	value = winner;
+}
+
+template < typename T >
+block_shape tune_cache(std::size_t n = 256) {
+	auto a = generate_random_matrix< T >(n, n);
+	auto b = generate_random_matrix< T >(n, n);
+	const std::vector< std::size_t > sizes = { 4, 8, 16, 32, 64, 128, 256 };
+	block_shape s = block_profile::current().cache;
+	auto run = [&] { a->cache_mul(*b, s); };
+	sweep(s.m, sizes, run);
+	sweep(s.n, sizes, run);
+	sweep(s.k, sizes, run);
+	return s;
+}
+
+template < typename T >
+gemm::blocking tune_packed(std::size_t n = 512) {
+	auto a = generate_random_matrix< T >(n, n);
+	auto b = generate_random_matrix< T >(n, n);
+	gemm::blocking bl = block_profile::current().packed;
+	auto run = [&] { a->packed_mul(*b, bl); };
+	sweep(bl.mc, { 32, 48, 64, 96, 128, 192, 256 }, run);
+	sweep(bl.kc, { 64, 128, 192, 256, 384, 512 }, run);
+	sweep(bl.nc, { 256, 512, 1024, 2048, 4096 }, run);
+	return bl;
+}
+
+/* tunes both kernels, installs the result as the current profile and
+ * stores it in block_profile::path() */
+template < typename T >
+block_profile run() {
+	block_profile& p = block_profile::current();
+	p.cache = tune_cache< T >();
+	p.packed = tune_packed< T >();
+	p.save(block_profile::path());
+	return p;
+}
+
+/* MATRIX_AUTOTUNE=1 ./matrix tunes before any benchmark runs */
+inline const bool at_startup = std::getenv("MATRIX_AUTOTUNE") && (run< double >(), true);
+
+} // namespace autotune
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "aligned_allocator.hpp"
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+
+/* `size()` matrices of height() x width() stored batch-interleaved: the
+ * matrices are grouped in chunks of `lanes` (one 64-byte line of T), and
+ * inside a chunk element (i, j) of all its matrices is contiguous.
+ *
+ *     data[(chunk * height * width + i * width + j) * lanes + lane]
+ *
+ * A vector register then holds the same element of `lanes` independent
+ * matrices, and the multiply is the ordinary triple loop with every scalar
+ * operation replaced by a vector one. The unused lanes of the last chunk
+ * are zero. */
+template < typename T >
+class matrix_batch {
+public:
+	static constexpr std::size_t lanes = 64 % sizeof(T) ? 1 : 64 / sizeof(T);
+
+	matrix_batch() = default;
+
+	matrix_batch(std::size_t count, std::size_t height, std::size_t width)
+			: _data(_chunks(count) * height * width * lanes),
+			  _n(count), _h(height), _w(width) {}
+
+	matrix_batch(const matrix< T >* ms, std::size_t count)
+			: matrix_batch(count, count ? ms[0].height() : 0, count ? ms[0].width() : 0) {
+		for (std::size_t b = 0; b < count; ++b) {
+			if (ms[b].height() != _h || ms[b].width() != _w)
+				throw std::logic_error("dimensions doesn't match");
+			for (std::size_t x = 0; x < _h; ++x)
+				for (std::size_t y = 0; y < _w; ++y)
+					at(b, x, y) = ms[b].at(x, y);
+		}
+	}
+
+	std::size_t size() const noexcept {
+		return _n;
+	}
+
+	std::size_t height() const noexcept {
+		return _h;
+	}
+
+	std::size_t width() const noexcept {
+		return _w;
+	}
+
+	T& at(std::size_t b, std::size_t x, std::size_t y) {
+		if (b >= _n || x >= _h || y >= _w)
+			throw std::logic_error("out of bounds");
+		return _data[((b / lanes * _h + x) * _w + y) * lanes + b % lanes];
+	}
+
+	const T& at(std::size_t b, std::size_t x, std::size_t y) const {
+		return const_cast< matrix_batch* >(this)->at(b, x, y);
+	}
+
+	/* copies matrix b out of the batch, reusing the storage of `m` when it
+	 * already has the right shape */
+	void get(std::size_t b, matrix< T >& m) const {
+		if (m.height() != _h || m.width() != _w)
+			m = matrix< T >(_h, _w);
+		for (std::size_t x = 0; x < _h; ++x)
+			for (std::size_t y = 0; y < _w; ++y)
+				m.at(x, y) = at(b, x, y);
+	}
+
+	const T* chunk(std::size_t c) const noexcept {
+		return _data.data() + c * _h * _w * lanes;
+	}
+
+	T* chunk(std::size_t c) noexcept {
+		return _data.data() + c * _h * _w * lanes;
+	}
+
+	std::size_t chunks() const noexcept {
+		return _chunks(_n);
+	}
+
+private:
+	static std::size_t _chunks(std::size_t n) noexcept {
+		return (n + lanes - 1) / lanes;
+	}
+
+	std::vector< T, aligned_allocator< T > > _data;
+	std::size_t _n = 0, _h = 0, _w = 0;
+};
+
+/* c = a * b for one chunk; v holds one element of every matrix of the chunk */
+template < typename T >
+void batch_mul_chunk(std::size_t h, std::size_t k, std::size_t w, const T* a, const T* b, T* c) {
+	constexpr std::size_t lanes = matrix_batch< T >::lanes;
+	typedef T v __attribute__((vector_size(lanes * sizeof(T))));
+	for (std::size_t i = 0; i < h; ++i) {
+		for (std::size_t j = 0; j < w; ++j) {
+			v acc = {}, x, y;
+			for (std::size_t l = 0; l < k; ++l) {
+				std::memcpy(&x, a + (i * k + l) * lanes, sizeof(v));
+				std::memcpy(&y, b + (l * w + j) * lanes, sizeof(v));
+				acc += x * y;
+			}
+			std::memcpy(c + (i * w + j) * lanes, &acc, sizeof(v));
+		}
+	}
+}
+
+/* out[i] = a[i] * b[i] for the whole batch, chunks spread over the pool */
+template < typename T >
+void batch_mul(const matrix_batch< T >& a, const matrix_batch< T >& b, matrix_batch< T >& out,
+		thread_pool& pool = thread_pool::instance()) {
+	if (a.size() != b.size() || a.width() != b.height())
+		throw std::logic_error("dimensions doesn't match");
+	if (out.size() != a.size() || out.height() != a.height() || out.width() != b.width())
+		out = matrix_batch< T >(a.size(), a.height(), b.width());
+
+	std::size_t h = a.height(), k = a.width(), w = b.width();
+	/* about 32K multiply-adds per task */
+	std::size_t work = std::max< std::size_t >(1, h * k * w * matrix_batch< T >::lanes);
+	std::size_t per_task = std::max< std::size_t >(1, (1 << 15) / work);
+	std::size_t chunks = a.chunks();
+	pool.parallel_for((chunks + per_task - 1) / per_task, [&](std::size_t t) {
+		for (std::size_t c = t * per_task; c < std::min(chunks, (t + 1) * per_task); ++c)
+			batch_mul_chunk(h, k, w, a.chunk(c), b.chunk(c), out.chunk(c));
+	});
+}
+
+/* out[i] = a[i] * b[i] for `count` separate matrices; converts to and from
+ * the interleaved layout around batch_mul */
+template < typename T >
+void batch_mul(const matrix< T >* a, const matrix< T >* b, std::size_t count, matrix< T >* out,
+		thread_pool& pool = thread_pool::instance()) {
+	matrix_batch< T > ba(a, count), bb(b, count), bo;
+	batch_mul(ba, bb, bo, pool);
+	for (std::size_t i = 0; i < count; ++i)
+		bo.get(i, out[i]);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <unistd.h>
+
+#include "gemm.hpp"
+
+/* tile sizes along the rows of A (m), the columns of B (n) and the shared
+ * dimension (k) */
+struct block_shape {
+	std::size_t m = 8;
+	std::size_t n = 8;
+	std::size_t k = 8;
+};
+
+/* Per-host blocking parameters. The profile is read once, on first use, from
+ * $MATRIX_PROFILE or ./matrix-<hostname>.profile; a missing or unreadable
+ * file leaves the built-in defaults in place. The file is plain text:
+ *
+ *     cache <m> <n> <k>
+ *     packed <mc> <nc> <kc>
+ */
+struct block_profile {
+	block_shape cache;
+	gemm::blocking packed;
+
+	static std::string path() {
+		if (const char* p = std::getenv("MATRIX_PROFILE"))
+			return p;
+		char host[256] = "localhost";
+		gethostname(host, sizeof(host) - 1);
+		return std::string("matrix-") + host + ".profile";
+	}
+
+	bool load(const std::string& file) {
+		std::ifstream in(file);
+		std::string key;
+		block_profile p = *this;
+		while (in >> key) {
+			if (key == "cache")
+				in >> p.cache.m >> p.cache.n >> p.cache.k;
+			else if (key == "packed")
+				in >> p.packed.mc >> p.packed.nc >> p.packed.kc;
+			else
+				return false;
+			if (!in)
+				return false;
+		}
+		if (!in.eof() || !p._valid())
+			return false;
+		*this = p;
+		return true;
+	}
+
+	bool save(const std::string& file) const {
+		std::ofstream out(file);
+		out << "cache " << cache.m << ' ' << cache.n << ' ' << cache.k << '\n'
+			<< "packed " << packed.mc << ' ' << packed.nc << ' ' << packed.kc << '\n';
+		return static_cast< bool >(out);
+	}
+
+	static block_profile& current() {
+		static block_profile p = [] {
+			block_profile r;
+			r.load(path());
+			return r;
+		}();
+		return p;
+	}
+
+private:
+	bool _valid() const noexcept {
+		return cache.m && cache.n && cache.k && packed.mc && packed.nc && packed.kc;
+	}
+};
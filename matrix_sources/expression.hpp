@@ -0,0 +1,408 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix.hpp"
+
+/* Lazy products and sums of matrices.
+ *
+ *     matrix< double > r = A * B * C + 2.0 * D;
+ *
+ * builds an expression holding pointers to A ... D; nothing is computed until
+ * it is converted to a matrix. A chain of factors is then multiplied in the
+ * order chosen by the matrix-chain dynamic program, and the last product of
+ * every term accumulates straight into the result together with the scaled
+ * element-wise terms, so no separate pass over the output is needed. The
+ * operands must outlive the expression; a sum that is multiplied may be
+ * evaluated into a matrix the expression owns, see operator* below. */
+
+template < typename T >
+struct scalar_of {
+	using type = T;
+};
+
+template < typename T >
+class product_expr {
+public:
+	product_expr(const matrix< T >& m, T scale = T{ 1 })
+			: _factors{ &m },
+			  _scale(scale) {}
+
+	/* a single factor kept alive by the expression and its copies */
+	static product_expr owning(matrix< T > m) {
+		auto p = std::make_shared< const matrix< T > >(std::move(m));
+		product_expr e(*p);
+		e._owned.push_back(std::move(p));
+		return e;
+	}
+
+	std::size_t height() const noexcept {
+		return _factors.front()->height();
+	}
+
+	std::size_t width() const noexcept {
+		return _factors.back()->width();
+	}
+
+	T scale() const noexcept {
+		return _scale;
+	}
+
+	const std::vector< const matrix< T >* >& factors() const noexcept {
+		return _factors;
+	}
+
+	product_expr& operator*=(const product_expr& e) {
+		if (width() != e.height())
+			throw std::logic_error("dimensions doesn't match");
+		_factors.insert(_factors.end(), e._factors.begin(), e._factors.end());
+		_owned.insert(_owned.end(), e._owned.begin(), e._owned.end());
+		_scale *= e._scale;
+		return *this;
+	}
+
+	product_expr& operator*=(T s) noexcept {
+		_scale *= s;
+		return *this;
+	}
+
+	/* factor i is dims()[i] x dims()[i + 1] */
+	std::vector< std::size_t > dims() const {
+		std::vector< std::size_t > d{ height() };
+		for (auto f : _factors)
+			d.push_back(f->width());
+		return d;
+	}
+
+	/* split[i][j]: the factor after which the product of factors i..j is
+	 * split; returns the number of scalar multiplications of that order */
+	std::size_t order(std::vector< std::vector< std::size_t > >& split) const {
+		return chain_cost(dims(), split);
+	}
+
+	/* scalar multiplications to add the product into a matrix */
+	std::size_t cost() const {
+		std::vector< std::vector< std::size_t > > split;
+		return order(split) + height() * width();
+	}
+
+	/* the matrix-chain dynamic program over factors of the given dims */
+	static std::size_t chain_cost(const std::vector< std::size_t >& dims,
+			std::vector< std::vector< std::size_t > >& split) {
+		std::size_t n = dims.size() - 1;
+		std::vector< std::vector< std::size_t > > cost(n, std::vector< std::size_t >(n, 0));
+		split.assign(n, std::vector< std::size_t >(n, 0));
+		for (std::size_t len = 1; len < n; ++len) {
+			for (std::size_t i = 0; i + len < n; ++i) {
+				std::size_t j = i + len;
+				cost[i][j] = std::numeric_limits< std::size_t >::max();
+				for (std::size_t k = i; k < j; ++k) {
+					std::size_t c = cost[i][k] + cost[k + 1][j] + dims[i] * dims[k + 1] * dims[j + 1];
+					if (c < cost[i][j]) {
+						cost[i][j] = c;
+						split[i][j] = k;
+					}
+				}
+			}
+		}
+		return cost[0][n - 1];
+	}
+
+	/* res += scale * product; res is row-major with leading dimension ld */
+	void accumulate(T* res, std::size_t ld) const {
+		std::vector< std::vector< std::size_t > > split;
+		order(split);
+		_apply(0, _factors.size() - 1, split, _scale, res, ld);
+	}
+
+	operator matrix< T >() const {
+		matrix< T > res(height(), width());
+		accumulate(res.data(), res.stride());
+		return res;
+	}
+
+private:
+	/* c += alpha * (factors i..j) */
+	void _apply(std::size_t i, std::size_t j, const std::vector< std::vector< std::size_t > >& split,
+			T alpha, T* c, std::size_t ldc) const {
+		if (i == j) {
+			const auto& m = *_factors[i];
+			for (std::size_t x = 0; x < m.height(); ++x)
+				for (std::size_t y = 0; y < m.width(); ++y)
+					c[x * ldc + y] += alpha * m.data()[x * m.stride() + y];
+			return;
+		}
+		std::size_t k = split[i][j];
+		matrix< T > lt, rt;
+		const matrix< T >& l = _materialize(i, k, split, lt);
+		const matrix< T >& r = _materialize(k + 1, j, split, rt);
+		gemm::multiply(l.height(), r.width(), l.width(), alpha,
+				l.data(), l.stride(),
+				r.data(), r.stride(),
+				c, ldc, block_profile::current().packed);
+	}
+
+	const matrix< T >& _materialize(std::size_t i, std::size_t j,
+			const std::vector< std::vector< std::size_t > >& split, matrix< T >& tmp) const {
+		if (i == j)
+			return *_factors[i];
+		tmp = matrix< T >(_factors[i]->height(), _factors[j]->width());
+		_apply(i, j, split, T{ 1 }, tmp.data(), tmp.stride());
+		return tmp;
+	}
+
+	std::vector< const matrix< T >* > _factors;
+	std::vector< std::shared_ptr< const matrix< T > > > _owned;
+	T _scale;
+};
+
+template < typename T >
+class sum_expr {
+public:
+	sum_expr(const product_expr< T >& e)
+			: _terms{ e } {}
+
+	std::size_t height() const noexcept {
+		return _terms.front().height();
+	}
+
+	std::size_t width() const noexcept {
+		return _terms.front().width();
+	}
+
+	sum_expr& operator+=(const sum_expr& e) {
+		if (height() != e.height() || width() != e.width())
+			throw std::logic_error("dimensions doesn't match");
+		_terms.insert(_terms.end(), e._terms.begin(), e._terms.end());
+		return *this;
+	}
+
+	sum_expr& operator*=(T s) noexcept {
+		for (auto& t : _terms)
+			t *= s;
+		return *this;
+	}
+
+	const std::vector< product_expr< T > >& terms() const noexcept {
+		return _terms;
+	}
+
+	/* scalar multiplications to evaluate the sum */
+	std::size_t cost() const {
+		std::size_t c = 0;
+		for (const auto& t : _terms)
+			c += t.cost();
+		return c;
+	}
+
+	/* the sum as one factor of a product: its only term as it is, otherwise
+	 * the evaluated matrix */
+	product_expr< T > as_factor() const {
+		if (_terms.size() == 1)
+			return _terms.front();
+		return product_expr< T >::owning(*this);
+	}
+
+	operator matrix< T >() const {
+		matrix< T > res(height(), width());
+		std::size_t ld = res.stride();
+
+		/* all element-wise terms in a single pass over the result */
+		std::vector< const product_expr< T >* > plain;
+		for (const auto& t : _terms)
+			if (t.factors().size() == 1)
+				plain.push_back(&t);
+		if (!plain.empty()) {
+			T* out = res.data();
+			for (std::size_t x = 0; x < height(); ++x) {
+				for (std::size_t y = 0; y < width(); ++y) {
+					T v{};
+					for (auto t : plain) {
+						const auto& m = *t->factors()[0];
+						v += t->scale() * m.data()[x * m.stride() + y];
+					}
+					out[x * ld + y] = v;
+				}
+			}
+		}
+
+		for (const auto& t : _terms)
+			if (t.factors().size() > 1)
+				t.accumulate(res.data(), ld);
+		return res;
+	}
+
+private:
+	std::vector< product_expr< T > > _terms;
+};
+
+/* products */
+
+template < typename T >
+product_expr< T > operator*(const matrix< T >& a, const matrix< T >& b) {
+	return product_expr< T >(a) *= b;
+}
+
+template < typename T >
+product_expr< T > operator*(product_expr< T > e, const matrix< T >& m) {
+	return e *= m;
+}
+
+template < typename T >
+product_expr< T > operator*(const matrix< T >& m, const product_expr< T >& e) {
+	return product_expr< T >(m) *= e;
+}
+
+template < typename T >
+product_expr< T > operator*(product_expr< T > a, const product_expr< T >& b) {
+	return a *= b;
+}
+
+/* scaling, from either side */
+
+template < typename T >
+product_expr< T > operator*(typename scalar_of< T >::type s, const matrix< T >& m) {
+	return product_expr< T >(m, s);
+}
+
+template < typename T >
+product_expr< T > operator*(typename scalar_of< T >::type s, product_expr< T > e) {
+	return e *= s;
+}
+
+template < typename T >
+sum_expr< T > operator*(typename scalar_of< T >::type s, sum_expr< T > e) {
+	return e *= s;
+}
+
+template < typename T >
+product_expr< T > operator*(const matrix< T >& m, typename scalar_of< T >::type s) {
+	return product_expr< T >(m, s);
+}
+
+template < typename T >
+product_expr< T > operator*(product_expr< T > e, typename scalar_of< T >::type s) {
+	return e *= s;
+}
+
+template < typename T >
+sum_expr< T > operator*(sum_expr< T > e, typename scalar_of< T >::type s) {
+	return e *= s;
+}
+
+/* Sums and differences take any two of matrix, product and sum; both
+ * sides are widened to a sum first. */
+
+template < typename E >
+struct expr_operand {
+	static constexpr bool value = false;
+};
+
+template < typename T >
+struct expr_operand< matrix< T > > {
+	static constexpr bool value = true;
+	using scalar = T;
+};
+
+template < typename T >
+struct expr_operand< product_expr< T > > {
+	static constexpr bool value = true;
+	using scalar = T;
+};
+
+template < typename T >
+struct expr_operand< sum_expr< T > > {
+	static constexpr bool value = true;
+	using scalar = T;
+};
+
+/* the common scalar type of two operands, only if both are expressions */
+template < typename A, typename B >
+using expr_scalar_t = std::enable_if_t< expr_operand< A >::value && expr_operand< B >::value
+		&& std::is_same< typename expr_operand< A >::scalar, typename expr_operand< B >::scalar >::value,
+		typename expr_operand< A >::scalar >;
+
+template < typename T >
+sum_expr< T > as_sum(const matrix< T >& m) {
+	return product_expr< T >(m);
+}
+
+template < typename T >
+sum_expr< T > as_sum(const product_expr< T >& e) {
+	return e;
+}
+
+template < typename T >
+sum_expr< T > as_sum(sum_expr< T > e) {
+	return e;
+}
+
+template < typename A, typename B, typename T = expr_scalar_t< A, B > >
+sum_expr< T > operator+(const A& a, const B& b) {
+	return as_sum(a) += as_sum(b);
+}
+
+template < typename A, typename B, typename T = expr_scalar_t< A, B > >
+sum_expr< T > operator-(const A& a, const B& b) {
+	return as_sum(a) += as_sum(b) *= T{ -1 };
+}
+
+/* A product with a sum on either side. A sum of several terms is evaluated
+ * once and its matrix becomes a single factor of the chain; the product is
+ * distributed over the terms instead, one chain per pair, only when the
+ * chain cost model counts fewer scalar multiplications for that, as for
+ * (X * Y + Z) * v with a thin v, where X * Y is never formed. */
+template < typename A, typename B, typename T = expr_scalar_t< A, B >,
+		typename = std::enable_if_t< std::is_same< A, sum_expr< T > >::value
+				|| std::is_same< B, sum_expr< T > >::value > >
+sum_expr< T > operator*(const A& a, const B& b) {
+	sum_expr< T > l = as_sum(a), r = as_sum(b);
+	if (l.width() != r.height())
+		throw std::logic_error("dimensions doesn't match");
+
+	using dims_t = std::vector< std::size_t >;
+	auto joined = [](dims_t d, const dims_t& e) {
+		d.insert(d.end(), e.begin() + 1, e.end());
+		return d;
+	};
+	auto factor = [](const sum_expr< T >& e) {
+		return e.terms().size() == 1 ? e.terms().front().dims() : dims_t{ e.height(), e.width() };
+	};
+	auto evaluation = [](const sum_expr< T >& e) {
+		return e.terms().size() == 1 ? 0 : e.cost();
+	};
+	std::vector< std::vector< std::size_t > > split;
+	std::size_t out = l.height() * r.width();
+	std::size_t evaluated = evaluation(l) + evaluation(r)
+			+ product_expr< T >::chain_cost(joined(factor(l), factor(r)), split) + out;
+	std::size_t distributed = 0;
+	for (const auto& lt : l.terms())
+		for (const auto& rt : r.terms())
+			distributed += product_expr< T >::chain_cost(joined(lt.dims(), rt.dims()), split) + out;
+
+	if (evaluated <= distributed)
+		return l.as_factor() *= r.as_factor();
+	auto term = [&](std::size_t i, std::size_t j) {
+		return product_expr< T >(l.terms()[i]) *= r.terms()[j];
+	};
+	sum_expr< T > res = term(0, 0);
+	for (std::size_t i = 0; i < l.terms().size(); ++i)
+		for (std::size_t j = 0; j < r.terms().size(); ++j)
+			if (i || j)
+				res += term(i, j);
+	return res;
+}
+
+/* evaluated left to right, every intermediate materialized */
+template < typename T >
+matrix< T > eager(const product_expr< T >& e) {
+	const auto& f = e.factors();
+	matrix< T > res = f[0]->packed_mul(*f[1]);
+	for (std::size_t i = 2; i < f.size(); ++i)
+		res = res.packed_mul(*f[i]);
+	return res;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix.hpp"
+
+/* R x C matrix with compile-time dimensions and inline storage. Products,
+ * sums and transposition are constexpr and fully unrolled through index
+ * sequences, so the compiler sees straight-line code it can keep in
+ * registers and vectorize (rows of the result are computed as
+ * res[i][*] += a[i][k] * b[k][*]). Intended for the small sizes, up to
+ * 16 x 16; the unrolled code grows as R * C * K. */
+template < typename T, std::size_t R, std::size_t C >
+class fixed_matrix {
+	template < typename, std::size_t, std::size_t > friend class fixed_matrix;
+
+	std::array< T, R * C > _m{};
+
+public:
+	constexpr fixed_matrix() = default;
+
+	constexpr fixed_matrix(const std::array< T, R * C >& elems)
+			: _m(elems) {}
+
+	explicit fixed_matrix(const matrix< T >& m) {
+		if (m.height() != R || m.width() != C)
+			throw std::logic_error("dimensions doesn't match");
+		for (std::size_t x = 0; x < R; ++x)
+			for (std::size_t y = 0; y < C; ++y)
+				_m[x * C + y] = m.at(x, y);
+	}
+
+	operator matrix< T >() const {
+		matrix< T > res(R, C);
+		for (std::size_t x = 0; x < R; ++x)
+			for (std::size_t y = 0; y < C; ++y)
+				res.at(x, y) = _m[x * C + y];
+		return res;
+	}
+
+	static constexpr std::size_t height() noexcept {
+		return R;
+	}
+
+	static constexpr std::size_t width() noexcept {
+		return C;
+	}
+
+	constexpr T& operator()(std::size_t x, std::size_t y) noexcept {
+		return _m[x * C + y];
+	}
+
+	constexpr const T& operator()(std::size_t x, std::size_t y) const noexcept {
+		return _m[x * C + y];
+	}
+
+	constexpr T& at(std::size_t x, std::size_t y) {
+		if (x >= R || y >= C)
+			throw std::logic_error("out of bounds");
+		return _m[x * C + y];
+	}
+
+	constexpr const T& at(std::size_t x, std::size_t y) const {
+		if (x >= R || y >= C)
+			throw std::logic_error("out of bounds");
+		return _m[x * C + y];
+	}
+
+	template < std::size_t K >
+	constexpr fixed_matrix< T, R, K > operator*(const fixed_matrix< T, C, K >& m) const {
+		fixed_matrix< T, R, K > res;
+		_mul(res, m, std::make_index_sequence< R >(), std::make_index_sequence< C >(), std::make_index_sequence< K >());
+		return res;
+	}
+
+	constexpr fixed_matrix operator+(const fixed_matrix& m) const {
+		fixed_matrix res;
+		_add(res, m, std::make_index_sequence< R * C >());
+		return res;
+	}
+
+	constexpr fixed_matrix< T, C, R > transpose() const {
+		fixed_matrix< T, C, R > res;
+		_transpose(res, std::make_index_sequence< R * C >());
+		return res;
+	}
+
+	constexpr bool operator==(const fixed_matrix& m) const {
+		for (std::size_t i = 0; i < R * C; ++i)
+			if (!(_m[i] == m._m[i]))
+				return false;
+		return true;
+	}
+
+	constexpr bool operator!=(const fixed_matrix& m) const {
+		return !(*this == m);
+	}
+
+private:
+	template < std::size_t K, std::size_t... Is, std::size_t... Ks, std::size_t... Js >
+	constexpr void _mul(fixed_matrix< T, R, K >& res, const fixed_matrix< T, C, K >& m,
+			std::index_sequence< Is... >, std::index_sequence< Ks... > ks, std::index_sequence< Js... > js) const {
+		(_mul_row< Is >(res, m, ks, js), ...);
+	}
+
+	template < std::size_t I, std::size_t K, std::size_t... Ks, std::size_t... Js >
+	constexpr void _mul_row(fixed_matrix< T, R, K >& res, const fixed_matrix< T, C, K >& m,
+			std::index_sequence< Ks... >, std::index_sequence< Js... > js) const {
+		(_axpy< I, Ks >(res, m, js), ...);
+	}
+
+	/* res[I][*] += this[I][k] * m[k][*] */
+	template < std::size_t I, std::size_t k, std::size_t K, std::size_t... Js >
+	constexpr void _axpy(fixed_matrix< T, R, K >& res, const fixed_matrix< T, C, K >& m, std::index_sequence< Js... >) const {
+		const T a = _m[I * C + k];
+		((res._m[I * K + Js] += a * m._m[k * K + Js]), ...);
+	}
+
+	template < std::size_t... Is >
+	constexpr void _add(fixed_matrix& res, const fixed_matrix& m, std::index_sequence< Is... >) const {
+		((res._m[Is] = _m[Is] + m._m[Is]), ...);
+	}
+
+	template < std::size_t... Is >
+	constexpr void _transpose(fixed_matrix< T, C, R >& res, std::index_sequence< Is... >) const {
+		((res._m[Is % C * R + Is / C] = _m[Is]), ...);
+	}
+};
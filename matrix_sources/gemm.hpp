@@ -0,0 +1,297 @@
+#pragma once
+
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86 1
+#endif
+
+/* Packed-panel matrix multiplication engine (Goto/BLIS loop structure).
+ *
+ * C += alpha * A * B, all operands row-major with an explicit leading
+ * dimension. A is packed into mc x kc blocks (kept in L2), B into kc x nc
+ * blocks (kept in L3 / streamed), and an mr x nr register-blocked micro-kernel
+ * walks both panels contiguously. */
+namespace gemm {
+
+struct blocking {
+	std::size_t mc = 96;
+	std::size_t kc = 256;
+	std::size_t nc = 2048;
+};
+
+template < typename T >
+struct micro {
+	static constexpr std::size_t mr = 4;
+	static constexpr std::size_t nr = 8;
+};
+
+/* one ymm of floats holds 8 columns, so the float tile is twice as wide */
+template <>
+struct micro< float > {
+	static constexpr std::size_t mr = 4;
+	static constexpr std::size_t nr = 16;
+};
+
+/* A block -> row panels of height mr, stored k-major: p[k * mr + i] */
+template < typename P, typename T >
+void pack_a(std::size_t mc, std::size_t kc, const T* a, std::size_t lda, P* p) {
+	constexpr std::size_t mr = micro< P >::mr;
+	for (std::size_t i = 0; i < mc; i += mr) {
+		std::size_t h = std::min(mr, mc - i);
+		for (std::size_t k = 0; k < kc; ++k) {
+			for (std::size_t ii = 0; ii < h; ++ii)
+				p[ii] = a[(i + ii) * lda + k];
+			for (std::size_t ii = h; ii < mr; ++ii)
+				p[ii] = P{};
+			p += mr;
+		}
+	}
+}
+
+/* B block -> column panels of width nr, stored k-major: p[k * nr + j] */
+template < typename P, typename T >
+void pack_b(std::size_t kc, std::size_t nc, const T* b, std::size_t ldb, P* p) {
+	constexpr std::size_t nr = micro< P >::nr;
+	for (std::size_t j = 0; j < nc; j += nr) {
+		std::size_t w = std::min(nr, nc - j);
+		for (std::size_t k = 0; k < kc; ++k) {
+			const T* row = b + k * ldb + j;
+			for (std::size_t jj = 0; jj < w; ++jj)
+				p[jj] = row[jj];
+			for (std::size_t jj = w; jj < nr; ++jj)
+				p[jj] = P{};
+			p += nr;
+		}
+	}
+}
+
+/* C[mr x nr] += alpha * a_panel * b_panel */
+template < typename T >
+void kernel_scalar(std::size_t kc, T alpha, const T* a, const T* b, T* c, std::size_t ldc) {
+	constexpr std::size_t mr = micro< T >::mr;
+	constexpr std::size_t nr = micro< T >::nr;
+	T acc[mr][nr] = {};
+	for (std::size_t k = 0; k < kc; ++k, a += mr, b += nr)
+		for (std::size_t i = 0; i < mr; ++i)
+			for (std::size_t j = 0; j < nr; ++j)
+				acc[i][j] += a[i] * b[j];
+	for (std::size_t i = 0; i < mr; ++i)
+		for (std::size_t j = 0; j < nr; ++j)
+			c[i * ldc + j] += alpha * acc[i][j];
+}
+
+#ifdef GEMM_X86
+/* 4x8 doubles: two ymm accumulators per row, 8 FMAs per k step */
+__attribute__((target("avx2,fma")))
+inline void kernel_avx2(std::size_t kc, double alpha, const double* a, const double* b, double* c, std::size_t ldc) {
+	__m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+	__m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+	__m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+	__m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+	for (std::size_t k = 0; k < kc; ++k, a += 4, b += 8) {
+		__m256d b0 = _mm256_loadu_pd(b);
+		__m256d b1 = _mm256_loadu_pd(b + 4);
+		__m256d a0 = _mm256_broadcast_sd(a);
+		c00 = _mm256_fmadd_pd(a0, b0, c00);
+		c01 = _mm256_fmadd_pd(a0, b1, c01);
+		__m256d a1 = _mm256_broadcast_sd(a + 1);
+		c10 = _mm256_fmadd_pd(a1, b0, c10);
+		c11 = _mm256_fmadd_pd(a1, b1, c11);
+		__m256d a2 = _mm256_broadcast_sd(a + 2);
+		c20 = _mm256_fmadd_pd(a2, b0, c20);
+		c21 = _mm256_fmadd_pd(a2, b1, c21);
+		__m256d a3 = _mm256_broadcast_sd(a + 3);
+		c30 = _mm256_fmadd_pd(a3, b0, c30);
+		c31 = _mm256_fmadd_pd(a3, b1, c31);
+	}
+	__m256d al = _mm256_set1_pd(alpha);
+	_mm256_storeu_pd(c, _mm256_fmadd_pd(al, c00, _mm256_loadu_pd(c)));
+	_mm256_storeu_pd(c + 4, _mm256_fmadd_pd(al, c01, _mm256_loadu_pd(c + 4)));
+	c += ldc;
+	_mm256_storeu_pd(c, _mm256_fmadd_pd(al, c10, _mm256_loadu_pd(c)));
+	_mm256_storeu_pd(c + 4, _mm256_fmadd_pd(al, c11, _mm256_loadu_pd(c + 4)));
+	c += ldc;
+	_mm256_storeu_pd(c, _mm256_fmadd_pd(al, c20, _mm256_loadu_pd(c)));
+	_mm256_storeu_pd(c + 4, _mm256_fmadd_pd(al, c21, _mm256_loadu_pd(c + 4)));
+	c += ldc;
+	_mm256_storeu_pd(c, _mm256_fmadd_pd(al, c30, _mm256_loadu_pd(c)));
+	_mm256_storeu_pd(c + 4, _mm256_fmadd_pd(al, c31, _mm256_loadu_pd(c + 4)));
+}
+
+/* 4x16 floats, same register layout as the double kernel */
+__attribute__((target("avx2,fma")))
+inline void kernel_avx2(std::size_t kc, float alpha, const float* a, const float* b, float* c, std::size_t ldc) {
+	__m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+	__m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+	__m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+	__m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+	for (std::size_t k = 0; k < kc; ++k, a += 4, b += 16) {
+		__m256 b0 = _mm256_loadu_ps(b);
+		__m256 b1 = _mm256_loadu_ps(b + 8);
+		__m256 a0 = _mm256_broadcast_ss(a);
+		c00 = _mm256_fmadd_ps(a0, b0, c00);
+		c01 = _mm256_fmadd_ps(a0, b1, c01);
+		__m256 a1 = _mm256_broadcast_ss(a + 1);
+		c10 = _mm256_fmadd_ps(a1, b0, c10);
+		c11 = _mm256_fmadd_ps(a1, b1, c11);
+		__m256 a2 = _mm256_broadcast_ss(a + 2);
+		c20 = _mm256_fmadd_ps(a2, b0, c20);
+		c21 = _mm256_fmadd_ps(a2, b1, c21);
+		__m256 a3 = _mm256_broadcast_ss(a + 3);
+		c30 = _mm256_fmadd_ps(a3, b0, c30);
+		c31 = _mm256_fmadd_ps(a3, b1, c31);
+	}
+	__m256 al = _mm256_set1_ps(alpha);
+	_mm256_storeu_ps(c, _mm256_fmadd_ps(al, c00, _mm256_loadu_ps(c)));
+	_mm256_storeu_ps(c + 8, _mm256_fmadd_ps(al, c01, _mm256_loadu_ps(c + 8)));
+	c += ldc;
+	_mm256_storeu_ps(c, _mm256_fmadd_ps(al, c10, _mm256_loadu_ps(c)));
+	_mm256_storeu_ps(c + 8, _mm256_fmadd_ps(al, c11, _mm256_loadu_ps(c + 8)));
+	c += ldc;
+	_mm256_storeu_ps(c, _mm256_fmadd_ps(al, c20, _mm256_loadu_ps(c)));
+	_mm256_storeu_ps(c + 8, _mm256_fmadd_ps(al, c21, _mm256_loadu_ps(c + 8)));
+	c += ldc;
+	_mm256_storeu_ps(c, _mm256_fmadd_ps(al, c30, _mm256_loadu_ps(c)));
+	_mm256_storeu_ps(c + 8, _mm256_fmadd_ps(al, c31, _mm256_loadu_ps(c + 8)));
+}
+
+inline bool has_avx2() {
+	static const bool r = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return r;
+}
+#else
+inline bool has_avx2() { return false; }
+#endif
+
+template < typename T >
+void kernel(std::size_t kc, T alpha, const T* a, const T* b, T* c, std::size_t ldc) {
+	kernel_scalar(kc, alpha, a, b, c, ldc);
+}
+
+#ifdef GEMM_X86
+template <>
+inline void kernel< double >(std::size_t kc, double alpha, const double* a, const double* b, double* c, std::size_t ldc) {
+	if (has_avx2())
+		kernel_avx2(kc, alpha, a, b, c, ldc);
+	else
+		kernel_scalar(kc, alpha, a, b, c, ldc);
+}
+
+template <>
+inline void kernel< float >(std::size_t kc, float alpha, const float* a, const float* b, float* c, std::size_t ldc) {
+	if (has_avx2())
+		kernel_avx2(kc, alpha, a, b, c, ldc);
+	else
+		kernel_scalar(kc, alpha, a, b, c, ldc);
+}
+#endif
+
+/* A path tells the driver how to pack and multiply one element type:
+ *
+ *     value_type      element of A and B
+ *     panel_type      element of the packed panels
+ *     result_type     element of C
+ *     mr, nr          micro-tile
+ *     depth(kc)       packed length of a kc-deep panel
+ *     pack_a, pack_b  fill one mc x kc / kc x nc block of panels
+ *     kernel          C[mr x nr] += a_panel * b_panel
+ *
+ * plain_path is the T -> T case with C += alpha * A * B. */
+template < typename T >
+struct plain_path {
+	using value_type = T;
+	using panel_type = T;
+	using result_type = T;
+	static constexpr std::size_t mr = micro< T >::mr;
+	static constexpr std::size_t nr = micro< T >::nr;
+
+	T alpha;
+
+	static std::size_t depth(std::size_t kc) noexcept {
+		return kc;
+	}
+
+	static void pack_a(std::size_t mc, std::size_t kc, const T* a, std::size_t lda, T* p) {
+		gemm::pack_a(mc, kc, a, lda, p);
+	}
+
+	static void pack_b(std::size_t kc, std::size_t nc, const T* b, std::size_t ldb, T* p) {
+		gemm::pack_b(kc, nc, b, ldb, p);
+	}
+
+	void kernel(std::size_t kc, const T* a, const T* b, T* c, std::size_t ldc) const {
+		gemm::kernel(kc, alpha, a, b, c, ldc);
+	}
+};
+
+/* the loop nest shared by all paths */
+template < typename Path >
+void drive(const Path& path, std::size_t m, std::size_t n, std::size_t k,
+		const typename Path::value_type* a, std::size_t lda,
+		const typename Path::value_type* b, std::size_t ldb,
+		typename Path::result_type* c, std::size_t ldc,
+		const blocking& bl) {
+	using P = typename Path::panel_type;
+	using R = typename Path::result_type;
+	constexpr std::size_t mr = Path::mr;
+	constexpr std::size_t nr = Path::nr;
+	if (m == 0 || n == 0 || k == 0)
+		return;
+
+	std::size_t mc = std::max(mr, bl.mc / mr * mr);
+	std::size_t nc = std::max(nr, bl.nc / nr * nr);
+	std::size_t kc = std::max< std::size_t >(1, bl.kc);
+
+	/* packing buffers are reused between calls on the same thread */
+	thread_local std::vector< P > pa, pb;
+	pa.resize(mc * path.depth(kc));
+	pb.resize(nc * path.depth(kc));
+
+	for (std::size_t jc = 0; jc < n; jc += nc) {
+		std::size_t nb = std::min(nc, n - jc);
+		for (std::size_t pc = 0; pc < k; pc += kc) {
+			std::size_t kb = std::min(kc, k - pc);
+			std::size_t depth = path.depth(kb);
+			path.pack_b(kb, nb, b + pc * ldb + jc, ldb, pb.data());
+			for (std::size_t ic = 0; ic < m; ic += mc) {
+				std::size_t mb = std::min(mc, m - ic);
+				path.pack_a(mb, kb, a + ic * lda + pc, lda, pa.data());
+				for (std::size_t jr = 0; jr < nb; jr += nr) {
+					std::size_t w = std::min(nr, nb - jr);
+					for (std::size_t ir = 0; ir < mb; ir += mr) {
+						std::size_t h = std::min(mr, mb - ir);
+						const P* ap = pa.data() + ir * depth;
+						const P* bp = pb.data() + jr * depth;
+						R* cp = c + (ic + ir) * ldc + jc + jr;
+						if (h == mr && w == nr) {
+							path.kernel(kb, ap, bp, cp, ldc);
+						} else {
+							/* partial tile on the right/bottom edge: compute
+							 * into a scratch tile and copy back */
+							R tmp[mr * nr] = {};
+							path.kernel(kb, ap, bp, tmp, nr);
+							for (std::size_t i = 0; i < h; ++i)
+								for (std::size_t j = 0; j < w; ++j)
+									cp[i * ldc + j] += tmp[i * nr + j];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+template < typename T >
+void multiply(std::size_t m, std::size_t n, std::size_t k, T alpha,
+		const T* a, std::size_t lda,
+		const T* b, std::size_t ldb,
+		T* c, std::size_t ldc,
+		const blocking& bl = blocking()) {
+	drive(plain_path< T >{ alpha }, m, n, k, a, lda, b, ldb, c, ldc, bl);
+}
+
+} // namespace gemm
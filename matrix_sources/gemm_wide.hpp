@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "gemm.hpp"
+
+/* Widening multiplies: C (widen< T >::type) += A * B (T). The element type
+ * picks the path through the specializations of widen:
+ *
+ *     float, double ...   plain packed multiply, no widening
+ *     int32_t             int64 panels, AVX2 vpmuldq: exact 32x32->64 bit
+ *                         products summed in int64
+ *     int16_t             pairs of k interleaved in the panels, AVX2 vpmaddwd:
+ *                         16 products per instruction summed into int32
+ *                         lanes, which are widened to int64 before they
+ *                         can overflow (the bound comes from max|a| and
+ *                         max|b| of the operands)
+ */
+namespace gemm {
+
+template < typename T >
+struct widen {
+	using type = T;
+
+	static void multiply(std::size_t m, std::size_t n, std::size_t k,
+			const T* a, std::size_t lda, const T* b, std::size_t ldb,
+			type* c, std::size_t ldc, const blocking& bl = blocking()) {
+		gemm::multiply(m, n, k, T{ 1 }, a, lda, b, ldb, c, ldc, bl);
+	}
+};
+
+/* largest |x| of an h x w block */
+template < typename T >
+std::int64_t max_abs(std::size_t h, std::size_t w, const T* p, std::size_t ld) {
+	std::int64_t r = 0;
+	for (std::size_t i = 0; i < h; ++i)
+		for (std::size_t j = 0; j < w; ++j)
+			r = std::max< std::int64_t >(r, p[i * ld + j] < 0 ? -std::int64_t(p[i * ld + j]) : p[i * ld + j]);
+	return r;
+}
+
+#ifdef GEMM_X86
+/* 4x8 int64 results from int32 values held in int64 lanes */
+__attribute__((target("avx2")))
+inline void kernel_i32_avx2(std::size_t kc, const std::int64_t* a, const std::int64_t* b, std::int64_t* c, std::size_t ldc) {
+	__m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+	__m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+	__m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+	__m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+	for (std::size_t k = 0; k < kc; ++k, a += 4, b += 8) {
+		__m256i b0 = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(b));
+		__m256i b1 = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(b + 4));
+		__m256i a0 = _mm256_set1_epi64x(a[0]);
+		c00 = _mm256_add_epi64(c00, _mm256_mul_epi32(a0, b0));
+		c01 = _mm256_add_epi64(c01, _mm256_mul_epi32(a0, b1));
+		__m256i a1 = _mm256_set1_epi64x(a[1]);
+		c10 = _mm256_add_epi64(c10, _mm256_mul_epi32(a1, b0));
+		c11 = _mm256_add_epi64(c11, _mm256_mul_epi32(a1, b1));
+		__m256i a2 = _mm256_set1_epi64x(a[2]);
+		c20 = _mm256_add_epi64(c20, _mm256_mul_epi32(a2, b0));
+		c21 = _mm256_add_epi64(c21, _mm256_mul_epi32(a2, b1));
+		__m256i a3 = _mm256_set1_epi64x(a[3]);
+		c30 = _mm256_add_epi64(c30, _mm256_mul_epi32(a3, b0));
+		c31 = _mm256_add_epi64(c31, _mm256_mul_epi32(a3, b1));
+	}
+	__m256i* r = reinterpret_cast< __m256i* >(c);
+	_mm256_storeu_si256(r, _mm256_add_epi64(_mm256_loadu_si256(r), c00));
+	_mm256_storeu_si256(r + 1, _mm256_add_epi64(_mm256_loadu_si256(r + 1), c01));
+	r = reinterpret_cast< __m256i* >(c += ldc);
+	_mm256_storeu_si256(r, _mm256_add_epi64(_mm256_loadu_si256(r), c10));
+	_mm256_storeu_si256(r + 1, _mm256_add_epi64(_mm256_loadu_si256(r + 1), c11));
+	r = reinterpret_cast< __m256i* >(c += ldc);
+	_mm256_storeu_si256(r, _mm256_add_epi64(_mm256_loadu_si256(r), c20));
+	_mm256_storeu_si256(r + 1, _mm256_add_epi64(_mm256_loadu_si256(r + 1), c21));
+	r = reinterpret_cast< __m256i* >(c += ldc);
+	_mm256_storeu_si256(r, _mm256_add_epi64(_mm256_loadu_si256(r), c30));
+	_mm256_storeu_si256(r + 1, _mm256_add_epi64(_mm256_loadu_si256(r + 1), c31));
+}
+
+/* int32 lanes of acc (one per column) widened and added to lo/hi */
+__attribute__((target("avx2")))
+inline void flush_i32(__m256i acc, __m256i& lo, __m256i& hi) {
+	lo = _mm256_add_epi64(lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(acc)));
+	hi = _mm256_add_epi64(hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(acc, 1)));
+}
+
+__attribute__((target("avx2")))
+inline void store_i64(std::int64_t* c, __m256i lo, __m256i hi) {
+	__m256i* r = reinterpret_cast< __m256i* >(c);
+	_mm256_storeu_si256(r, _mm256_add_epi64(_mm256_loadu_si256(r), lo));
+	_mm256_storeu_si256(r + 1, _mm256_add_epi64(_mm256_loadu_si256(r + 1), hi));
+}
+
+/* 4x8 tile over `pairs` interleaved k pairs; the int32 sums are widened
+ * into int64 registers every `flush` pairs */
+__attribute__((target("avx2")))
+inline void kernel_i16_avx2(std::size_t pairs, std::size_t flush, const std::int16_t* a, const std::int16_t* b,
+		std::int64_t* c, std::size_t ldc) {
+	__m256i l0 = _mm256_setzero_si256(), h0 = _mm256_setzero_si256();
+	__m256i l1 = _mm256_setzero_si256(), h1 = _mm256_setzero_si256();
+	__m256i l2 = _mm256_setzero_si256(), h2 = _mm256_setzero_si256();
+	__m256i l3 = _mm256_setzero_si256(), h3 = _mm256_setzero_si256();
+	for (std::size_t q0 = 0; q0 < pairs; q0 += flush) {
+		std::size_t q1 = std::min(pairs, q0 + flush);
+		__m256i c0 = _mm256_setzero_si256(), c1 = _mm256_setzero_si256();
+		__m256i c2 = _mm256_setzero_si256(), c3 = _mm256_setzero_si256();
+		for (std::size_t q = q0; q < q1; ++q) {
+			__m256i bv = _mm256_loadu_si256(reinterpret_cast< const __m256i* >(b + q * 16));
+			std::int32_t x[4];
+			std::memcpy(x, a + q * 8, sizeof(x));
+			c0 = _mm256_add_epi32(c0, _mm256_madd_epi16(_mm256_set1_epi32(x[0]), bv));
+			c1 = _mm256_add_epi32(c1, _mm256_madd_epi16(_mm256_set1_epi32(x[1]), bv));
+			c2 = _mm256_add_epi32(c2, _mm256_madd_epi16(_mm256_set1_epi32(x[2]), bv));
+			c3 = _mm256_add_epi32(c3, _mm256_madd_epi16(_mm256_set1_epi32(x[3]), bv));
+		}
+		flush_i32(c0, l0, h0);
+		flush_i32(c1, l1, h1);
+		flush_i32(c2, l2, h2);
+		flush_i32(c3, l3, h3);
+	}
+	store_i64(c, l0, h0);
+	store_i64(c + ldc, l1, h1);
+	store_i64(c + 2 * ldc, l2, h2);
+	store_i64(c + 3 * ldc, l3, h3);
+}
+#endif
+
+struct i32_path {
+	using value_type = std::int32_t;
+	using panel_type = std::int64_t;
+	using result_type = std::int64_t;
+	static constexpr std::size_t mr = micro< std::int64_t >::mr;
+	static constexpr std::size_t nr = micro< std::int64_t >::nr;
+
+	static std::size_t depth(std::size_t kc) noexcept {
+		return kc;
+	}
+
+	static void pack_a(std::size_t mc, std::size_t kc, const std::int32_t* a, std::size_t lda, std::int64_t* p) {
+		gemm::pack_a(mc, kc, a, lda, p);
+	}
+
+	static void pack_b(std::size_t kc, std::size_t nc, const std::int32_t* b, std::size_t ldb, std::int64_t* p) {
+		gemm::pack_b(kc, nc, b, ldb, p);
+	}
+
+	void kernel(std::size_t kc, const std::int64_t* a, const std::int64_t* b, std::int64_t* c, std::size_t ldc) const {
+#ifdef GEMM_X86
+		if (has_avx2())
+			return kernel_i32_avx2(kc, a, b, c, ldc);
+#endif
+		kernel_scalar< std::int64_t >(kc, 1, a, b, c, ldc);
+	}
+};
+
+/* Panels hold k in pairs: A as p[(q * mr + i) * 2 + s] = a[i][2q + s],
+ * B as p[(q * nr + j) * 2 + s] = b[2q + s][j]. When two products might not
+ * fit one int32 lane (both operands reach -32768), `single` gives every k
+ * its own pair with a zero partner. */
+struct i16_path {
+	using value_type = std::int16_t;
+	using panel_type = std::int16_t;
+	using result_type = std::int64_t;
+	static constexpr std::size_t mr = 4;
+	static constexpr std::size_t nr = 8;
+
+	bool single;
+	/* pairs summed in int32 before they are widened */
+	std::size_t flush;
+
+	std::size_t depth(std::size_t kc) const noexcept {
+		return single ? 2 * kc : (kc + 1) / 2 * 2;
+	}
+
+	void pack_a(std::size_t mc, std::size_t kc, const std::int16_t* a, std::size_t lda, std::int16_t* p) const {
+		std::size_t step = single ? 1 : 2;
+		for (std::size_t i = 0; i < mc; i += mr) {
+			for (std::size_t k = 0; k < kc; k += step) {
+				for (std::size_t ii = 0; ii < mr; ++ii) {
+					bool row = i + ii < mc;
+					*p++ = row ? a[(i + ii) * lda + k] : 0;
+					*p++ = row && !single && k + 1 < kc ? a[(i + ii) * lda + k + 1] : 0;
+				}
+			}
+		}
+	}
+
+	void pack_b(std::size_t kc, std::size_t nc, const std::int16_t* b, std::size_t ldb, std::int16_t* p) const {
+		std::size_t step = single ? 1 : 2;
+		for (std::size_t j = 0; j < nc; j += nr) {
+			for (std::size_t k = 0; k < kc; k += step) {
+				for (std::size_t jj = 0; jj < nr; ++jj) {
+					bool col = j + jj < nc;
+					*p++ = col ? b[k * ldb + j + jj] : 0;
+					*p++ = col && !single && k + 1 < kc ? b[(k + 1) * ldb + j + jj] : 0;
+				}
+			}
+		}
+	}
+
+	void kernel(std::size_t kc, const std::int16_t* a, const std::int16_t* b, std::int64_t* c, std::size_t ldc) const {
+		std::size_t pairs = depth(kc) / 2;
+#ifdef GEMM_X86
+		if (has_avx2())
+			return kernel_i16_avx2(pairs, flush, a, b, c, ldc);
+#endif
+		std::int64_t acc[mr][nr] = {};
+		for (std::size_t q = 0; q < pairs; ++q, a += 2 * mr, b += 2 * nr)
+			for (std::size_t i = 0; i < mr; ++i)
+				for (std::size_t j = 0; j < nr; ++j)
+					acc[i][j] += std::int64_t(a[2 * i]) * b[2 * j] + std::int64_t(a[2 * i + 1]) * b[2 * j + 1];
+		for (std::size_t i = 0; i < mr; ++i)
+			for (std::size_t j = 0; j < nr; ++j)
+				c[i * ldc + j] += acc[i][j];
+	}
+};
+
+template <>
+struct widen< std::int32_t > {
+	using type = std::int64_t;
+
+	static void multiply(std::size_t m, std::size_t n, std::size_t k,
+			const std::int32_t* a, std::size_t lda, const std::int32_t* b, std::size_t ldb,
+			type* c, std::size_t ldc, const blocking& bl = blocking()) {
+		/* a single product is below 2^62, so only the sum can overflow */
+		std::int64_t product = max_abs(m, k, a, lda) * max_abs(k, n, b, ldb);
+		if (k && product > INT64_MAX / std::int64_t(k))
+			throw std::overflow_error("int32 product may overflow int64");
+		drive(i32_path(), m, n, k, a, lda, b, ldb, c, ldc, bl);
+	}
+};
+
+template <>
+struct widen< std::int16_t > {
+	using type = std::int64_t;
+
+	static void multiply(std::size_t m, std::size_t n, std::size_t k,
+			const std::int16_t* a, std::size_t lda, const std::int16_t* b, std::size_t ldb,
+			type* c, std::size_t ldc, const blocking& bl = blocking()) {
+		/* one vpmaddwd lane is at most 2 * max|a| * max|b|, which does not
+		 * fit once when both operands contain -32768 (2^31) */
+		std::int64_t product = max_abs(m, k, a, lda) * max_abs(k, n, b, ldb);
+		bool single = 2 * product > INT32_MAX;
+		std::int64_t lane = std::max< std::int64_t >(1, single ? product : 2 * product);
+		drive(i16_path{ single, std::size_t(INT32_MAX / lane) }, m, n, k, a, lda, b, ldb, c, ldc, bl);
+	}
+};
+
+} // namespace gemm
@@ -6,7 +6,14 @@
 #include <brick-benchmark>
 #include <climits>
 #include <string>
+#include <thread>
 #include "matrix.hpp"
+#include "autotune.hpp"
+#include "expression.hpp"
+#include "fixed_matrix.hpp"
+#include "batch.hpp"
+#include "mapped_matrix.hpp"
+#include "sparse_matrix.hpp"
 
 using namespace brick;
 
@@ -24,12 +31,20 @@ struct hw5 : benchmark::Group {
 		y.type = benchmark::Axis::Qualitative;
 		y.name = "implementation";
 		y.min = 2;
-		y.max = 3;
+		y.max = 11;
 		y._render = [](int i) {
 		    switch (i) {
 		    case 1: return "natural order";
 		    case 2: return "cache-efficient order(8)";
 			case 3: return "natural order(pararell)";
+			case 4: return "packed panels";
+			case 5: return "tiled parallel";
+			case 6: return "recursive(32)";
+			case 7: return "strassen-winograd(32, 2 levels)";
+			case 8: return "int16 -> int64";
+			case 9: return "int32 -> int64";
+			case 10: return "float";
+			case 11: return "mul_into (preallocated)";
 		    }
 		};
 	}
@@ -38,6 +53,23 @@ struct hw5 : benchmark::Group {
 		p = _p; q = _q;
 		m1 = generate_random_matrix< double >(p, p);
 		m2 = generate_random_matrix< double >(p, p);
+		switch (q) {
+		case 8:
+			s1 = generate_random_matrix< std::int16_t >(p, p);
+			s2 = generate_random_matrix< std::int16_t >(p, p);
+			break;
+		case 9:
+			i1 = generate_random_matrix< std::int32_t >(p, p);
+			i2 = generate_random_matrix< std::int32_t >(p, p);
+			break;
+		case 10:
+			f1 = generate_random_matrix< float >(p, p);
+			f2 = generate_random_matrix< float >(p, p);
+			break;
+		case 11:
+			res = mtx_t(p, p);
+			break;
+		}
 	}
 
 	BENCHMARK(multiplication) {
@@ -45,11 +77,536 @@ struct hw5 : benchmark::Group {
 		case 1: m1->natural_mul(*m2); break;
 		case 2: m1->cache_mul(*m2); break;
 		case 3: m1->natural_mul_pararell(*m2); break;
+		case 4: m1->packed_mul(*m2); break;
+		case 5: m1->parallel_mul(*m2); break;
+		case 6: m1->recursive_mul(*m2, 32); break;
+		case 7: m1->recursive_mul(*m2, 32, 2); break;
+		case 8: s1->wide_mul(*s2); break;
+		case 9: i1->wide_mul(*i2); break;
+		case 10: f1->wide_mul(*f2); break;
+		case 11: mul_into(*m1, *m2, res); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+	std::unique_ptr< matrix< std::int16_t > > s1, s2;
+	std::unique_ptr< matrix< std::int32_t > > i1, i2;
+	std::unique_ptr< matrix< float > > f1, f2;
+	mtx_t res;
+};
+
+/* speedup of the tiled parallel multiply: time against the number of threads */
+struct hw5_threads : benchmark::Group {
+
+	hw5_threads() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "threads";
+		x.min = 1;
+		x.max = std::max(1u, std::thread::hardware_concurrency());
+		x.log = false;
+		x.step = 1;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "size";
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "256x256";
+			case 2: return "512x512";
+			case 3: return "1024x1024";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		std::size_t n = 128 << q;
+		pool = std::make_unique< thread_pool >(p);
+		m1 = generate_random_matrix< double >(n, n);
+		m2 = generate_random_matrix< double >(n, n);
+	}
+
+	BENCHMARK(multiplication) {
+		m1->parallel_mul(*m2, *pool);
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< thread_pool > pool;
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+};
+
+/* the sweep behind autotune::tune_cache: one block dimension varies, the
+ * other two keep their profile value */
+struct tune : benchmark::Group {
+
+	tune() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "block";
+		x.min = 4;
+		x.max = 256;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "dimension";
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "M";
+			case 2: return "N";
+			case 3: return "K";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		shape = block_profile::current().cache;
+		switch (q) {
+		case 1: shape.m = p; break;
+		case 2: shape.n = p; break;
+		case 3: shape.k = p; break;
+		}
+		m1 = generate_random_matrix< double >(256, 256);
+		m2 = generate_random_matrix< double >(256, 256);
+	}
+
+	BENCHMARK(cache_mul) {
+		m1->cache_mul(*m2, shape);
+	}
+
+	using mtx_t = matrix< double >;
+
+	block_shape shape;
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+};
+
+/* A * B * C * D * E with shapes n x s, s x n, n x s, s x n, n x 8 */
+struct chain : benchmark::Group {
+
+	chain() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "n";
+		x.min = 100;
+		x.max = 1000;
+		x.log = false;
+		x.step = 100;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "evaluation";
+		y.min = 1;
+		y.max = 2;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "left to right";
+			case 2: return "lazy(matrix-chain order)";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		std::size_t s = p / 16 + 1;
+		std::size_t dims[] = { std::size_t(p), s, std::size_t(p), s, std::size_t(p), 8 };
+		for (unsigned i = 0; i < 5; ++i)
+			m[i] = generate_random_matrix< double >(dims[i], dims[i + 1]);
+	}
+
+	BENCHMARK(product) {
+		auto e = *m[0] * *m[1] * *m[2] * *m[3] * *m[4];
+		switch (q) {
+		case 1: eager(e); break;
+		case 2: static_cast< matrix< double > >(e); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< mtx_t > m[5];
+};
+
+/* (A * B) * s + (A + B) over n x n: a product, a scaling and two sums */
+struct scaled_sum : benchmark::Group {
+
+	scaled_sum() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "[x][x]";
+		x.min = 100;
+		x.max = 1000;
+		x.log = false;
+		x.step = 100;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "evaluation";
+		y.min = 1;
+		y.max = 2;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "separate passes";
+			case 2: return "lazy(fused terms)";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		m1 = generate_random_matrix< double >(p, p);
+		m2 = generate_random_matrix< double >(p, p);
+	}
+
+	BENCHMARK(sum) {
+		switch (q) {
+		case 1: {
+			mtx_t r = m1->packed_mul(*m2);
+			for (std::size_t i = 0; i < r.height(); ++i)
+				for (std::size_t j = 0; j < r.width(); ++j)
+					r.at(i, j) *= 0.5;
+			for (std::size_t i = 0; i < r.height(); ++i)
+				for (std::size_t j = 0; j < r.width(); ++j)
+					r.at(i, j) += m1->at(i, j) + m2->at(i, j);
+			break;
+		}
+		case 2: static_cast< mtx_t >((*m1 * *m2) * 0.5 + (*m1 + *m2)); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+};
+
+/* cache set aliasing around n = 512: rows exactly n apart against the
+ * padded default leading dimension */
+struct stride : benchmark::Group {
+
+	stride() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "[x][x]";
+		x.min = 496;
+		x.max = 528;
+		x.log = false;
+		x.step = 4;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "leading dimension";
+		y.min = 1;
+		y.max = 2;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "width";
+			case 2: return "padded";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		std::size_t ld = q == 1 ? p : mtx_t::leading_dimension(p);
+		auto a = generate_random_matrix< double >(p, p);
+		auto b = generate_random_matrix< double >(p, p);
+		m1 = std::make_unique< mtx_t >(p, p, ld);
+		m2 = std::make_unique< mtx_t >(p, p, ld);
+		for (int i = 0; i < p; ++i) {
+			for (int j = 0; j < p; ++j) {
+				m1->at(i, j) = a->at(i, j);
+				m2->at(i, j) = b->at(i, j);
+			}
+		}
+	}
+
+	BENCHMARK(cache_mul) {
+		m1->cache_mul(*m2);
+	}
+
+	BENCHMARK(packed_mul) {
+		m1->packed_mul(*m2);
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+};
+
+/* the small transform sizes, where compile-time dimensions pay off */
+struct hw5_small : hw5 {
+
+	hw5_small() {
+		x.min = 2;
+		x.max = 16;
+		x.step = 2;
+
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "natural order";
+			case 2: return "cache-efficient order";
+			case 3: return "fixed_matrix";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		hw5::setup(_p, _q);
+		if (q == 3)
+			_dispatch(true);
+	}
+
+	BENCHMARK(small_multiplication) {
+		switch (q) {
+		case 1: m1->natural_mul(*m2); break;
+		case 2: m1->cache_mul(*m2); break;
+		case 3: _dispatch(false); break;
+		}
+	}
+
+	template < std::size_t N >
+	struct operands {
+		using mtx_t = fixed_matrix< double, N, N >;
+		inline static mtx_t a, b, res;
+	};
+
+	template < std::size_t N >
+	void _run(bool fill) {
+		using o = operands< N >;
+		if (fill) {
+			o::a = typename o::mtx_t(*m1);
+			o::b = typename o::mtx_t(*m2);
+		} else {
+			o::res = o::a * o::b;
+		}
+	}
+
+	void _dispatch(bool fill) {
+		switch (p) {
+		case 2: _run< 2 >(fill); break;
+		case 4: _run< 4 >(fill); break;
+		case 6: _run< 6 >(fill); break;
+		case 8: _run< 8 >(fill); break;
+		case 10: _run< 10 >(fill); break;
+		case 12: _run< 12 >(fill); break;
+		case 14: _run< 14 >(fill); break;
+		case 16: _run< 16 >(fill); break;
+		}
+	}
+};
+
+/* 4096 independent products of [x][x] matrices */
+struct batch : benchmark::Group {
+
+	batch() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "[x][x]";
+		x.min = 4;
+		x.max = 32;
+		x.log = false;
+		x.step = 4;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "cache_mul loop";
+			case 2: return "batch_mul(matrices)";
+			case 3: return "batch_mul(interleaved)";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		a.clear();
+		b.clear();
+		res.assign(count, mtx_t());
+		for (std::size_t i = 0; i < count; ++i) {
+			a.push_back(*generate_random_matrix< double >(p, p));
+			b.push_back(*generate_random_matrix< double >(p, p));
+		}
+		ba = matrix_batch< double >(a.data(), count);
+		bb = matrix_batch< double >(b.data(), count);
+	}
+
+	BENCHMARK(multiplication) {
+		switch (q) {
+		case 1:
+			for (std::size_t i = 0; i < count; ++i)
+				res[i] = a[i].cache_mul(b[i]);
+			break;
+		case 2: batch_mul(a.data(), b.data(), count, res.data()); break;
+		case 3: batch_mul(ba, bb, bo); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	static constexpr std::size_t count = 4096;
+	std::vector< mtx_t > a, b, res;
+	matrix_batch< double > ba, bb, bo;
+};
+
+/* [x][x] product from tiled files under /tmp against the in-memory kernel */
+struct out_of_core : benchmark::Group {
+
+	out_of_core() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "[x][x]";
+		x.min = 256;
+		x.max = 2048;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 2;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "packed_mul";
+			case 2: return "out_of_core_mul";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		m1 = generate_random_matrix< double >(p, p);
+		m2 = generate_random_matrix< double >(p, p);
+		if (q == 2) {
+			f1 = mapped_matrix< double >::create(paths[0], *m1, tile);
+			f2 = mapped_matrix< double >::create(paths[1], *m2, tile);
+			res = mapped_matrix< double >::create(paths[2], p, p, tile);
+			/* the mappings keep the files alive, nothing is left in /tmp
+			 * once they are closed */
+			for (const char* path : paths)
+				unlink(path);
+		}
+	}
+
+	BENCHMARK(multiplication) {
+		switch (q) {
+		case 1: m1->packed_mul(*m2); break;
+		case 2: out_of_core_mul(f1, f2, res, budget); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	static constexpr const char* paths[] = { "/tmp/out_of_core_a.mtx", "/tmp/out_of_core_b.mtx",
+			"/tmp/out_of_core_c.mtx" };
+	static constexpr std::size_t tile = 256;
+	/* small enough that the larger sizes really stream */
+	static constexpr std::size_t budget = std::size_t(8) << 20;
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+	mapped_matrix< double > f1, f2, res;
+};
+
+/* natural order against a contiguous right operand, from the hw5 sizes up */
+struct transposed : benchmark::Group {
+
+	transposed() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "[x][x]";
+		x.min = 10;
+		x.max = 1280;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 5;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "natural_mul";
+			case 2: return "transpose + mul_transposed";
+			case 3: return "mul_transposed (pre-transposed)";
+			case 4: return "transpose()";
+			case 5: return "transpose_in_place()";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		m1 = generate_random_matrix< double >(p, p);
+		m2 = generate_random_matrix< double >(p, p);
+		t2 = m2->transpose();
+	}
+
+	BENCHMARK(multiplication) {
+		switch (q) {
+		case 1: m1->natural_mul(*m2); break;
+		case 2: m1->mul_transposed(m2->transpose()); break;
+		case 3: m1->mul_transposed(t2); break;
+		case 4: m2->transpose(); break;
+		case 5: m2->transpose_in_place(); break;
+		}
+	}
+
+	using mtx_t = matrix< double >;
+
+	std::unique_ptr< mtx_t > m1;
+	std::unique_ptr< mtx_t > m2;
+	mtx_t t2;
+};
+
+/* 512x512 operands of growing density: where the sparse kernels stop paying off */
+struct sparse : benchmark::Group {
+
+	sparse() {
+		x.type = benchmark::Axis::Quantitative;
+		x.name = "density [%]";
+		x.min = 1;
+		x.max = 64;
+		x.log = true;
+		x.step = 2;
+
+		y.type = benchmark::Axis::Qualitative;
+		y.name = "implementation";
+		y.min = 1;
+		y.max = 3;
+		y._render = [](int i) {
+			switch (i) {
+			case 1: return "cache_mul (dense)";
+			case 2: return "sparse x dense";
+			case 3: return "sparse x sparse";
+			}
+		};
+	}
+
+	void setup(int _p, int _q) override {
+		p = _p; q = _q;
+		s1 = generate_random_sparse_matrix< double >(size, size, p / 100.0);
+		s2 = generate_random_sparse_matrix< double >(size, size, p / 100.0);
+		m1 = std::make_unique< mtx_t >(*s1);
+		m2 = std::make_unique< mtx_t >(*s2);
+	}
+
+	BENCHMARK(multiplication) {
+		switch (q) {
+		case 1: m1->cache_mul(*m2); break;
+		case 2: s1->mul_dense(*m2); break;
+		case 3: s1->mul_sparse(*s2); break;
 		}
 	}
 
 	using mtx_t = matrix< double >;
 
+	static constexpr std::size_t size = 512;
 	std::unique_ptr< mtx_t > m1;
 	std::unique_ptr< mtx_t > m2;
+	std::unique_ptr< sparse_matrix< double > > s1, s2;
 };
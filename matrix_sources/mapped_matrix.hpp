@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "block_profile.hpp"
+#include "gemm.hpp"
+#include "matrix.hpp"
+
+/* On-disk matrix: one page of header followed by tile x tile blocks in
+ * row-major order of blocks, every block itself row-major with a leading
+ * dimension of `tile`. Blocks on the right/bottom edge are zero padded to
+ * the full tile, so every block has the same size and offset formula:
+ *
+ *     data + ((I * tiles_w) + J) * tile * tile
+ */
+struct mapped_header {
+	static constexpr char magic_value[8] = { 'M', 'T', 'X', 'T', 'I', 'L', 'E', '\0' };
+	static constexpr std::uint32_t current_version = 1;
+	static constexpr std::size_t size = 4096;
+
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t elem_size;
+	std::uint64_t rows;
+	std::uint64_t cols;
+	std::uint64_t tile;
+};
+
+template < typename T >
+class mapped_matrix {
+public:
+	mapped_matrix() = default;
+
+	mapped_matrix(const mapped_matrix&) = delete;
+	mapped_matrix& operator=(const mapped_matrix&) = delete;
+
+	mapped_matrix(mapped_matrix&& m) noexcept {
+		*this = std::move(m);
+	}
+
+	mapped_matrix& operator=(mapped_matrix&& m) noexcept {
+		std::swap(_fd, m._fd);
+		std::swap(_map, m._map);
+		std::swap(_bytes, m._bytes);
+		std::swap(_rows, m._rows);
+		std::swap(_cols, m._cols);
+		std::swap(_tile, m._tile);
+		return *this;
+	}
+
+	~mapped_matrix() {
+		if (_map)
+			munmap(_map, _bytes);
+		if (_fd >= 0)
+			close(_fd);
+	}
+
+	/* new zero-filled file, mapped read-write */
+	static mapped_matrix create(const std::string& path, std::size_t rows, std::size_t cols, std::size_t tile) {
+		if (tile == 0)
+			throw std::logic_error("tile size must be positive");
+		mapped_matrix m;
+		m._fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (m._fd < 0)
+			throw std::runtime_error("cannot create " + path);
+		m._rows = rows;
+		m._cols = cols;
+		m._tile = tile;
+		m._bytes = mapped_header::size + m.tiles_h() * m.tiles_w() * tile * tile * sizeof(T);
+		if (ftruncate(m._fd, m._bytes) != 0)
+			throw std::runtime_error("cannot resize " + path);
+		m._map_file(PROT_READ | PROT_WRITE);
+		mapped_header h;
+		std::memcpy(h.magic, mapped_header::magic_value, sizeof(h.magic));
+		h.version = mapped_header::current_version;
+		h.elem_size = sizeof(T);
+		h.rows = rows;
+		h.cols = cols;
+		h.tile = tile;
+		std::memcpy(m._map, &h, sizeof(h));
+		return m;
+	}
+
+	static mapped_matrix create(const std::string& path, const matrix< T >& src, std::size_t tile) {
+		auto m = create(path, src.height(), src.width(), tile);
+		for (std::size_t x = 0; x < src.height(); ++x)
+			for (std::size_t y = 0; y < src.width(); ++y)
+				m._ref(x, y) = src.at(x, y);
+		return m;
+	}
+
+	static mapped_matrix open(const std::string& path, bool writable = false) {
+		mapped_matrix m;
+		m._fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+		if (m._fd < 0)
+			throw std::runtime_error("cannot open " + path);
+		struct stat st;
+		if (fstat(m._fd, &st) != 0 || std::size_t(st.st_size) < mapped_header::size)
+			throw std::runtime_error("not a matrix file: " + path);
+		m._bytes = st.st_size;
+		m._map_file(writable ? PROT_READ | PROT_WRITE : PROT_READ);
+		mapped_header h;
+		std::memcpy(&h, m._map, sizeof(h));
+		if (std::memcmp(h.magic, mapped_header::magic_value, sizeof(h.magic)) != 0
+				|| h.version != mapped_header::current_version)
+			throw std::runtime_error("not a matrix file: " + path);
+		if (h.elem_size != sizeof(T) || h.tile == 0)
+			throw std::runtime_error("element size mismatch: " + path);
+		m._rows = h.rows;
+		m._cols = h.cols;
+		m._tile = h.tile;
+		if (m._bytes < mapped_header::size + m.tiles_h() * m.tiles_w() * m._tile * m._tile * sizeof(T))
+			throw std::runtime_error("truncated matrix file: " + path);
+		return m;
+	}
+
+	std::size_t height() const noexcept {
+		return _rows;
+	}
+
+	std::size_t width() const noexcept {
+		return _cols;
+	}
+
+	std::size_t tile() const noexcept {
+		return _tile;
+	}
+
+	std::size_t tiles_h() const noexcept {
+		return (_rows + _tile - 1) / _tile;
+	}
+
+	std::size_t tiles_w() const noexcept {
+		return (_cols + _tile - 1) / _tile;
+	}
+
+	std::size_t tile_bytes() const noexcept {
+		return _tile * _tile * sizeof(T);
+	}
+
+	const T* block(std::size_t i, std::size_t j) const noexcept {
+		return _data() + (i * tiles_w() + j) * _tile * _tile;
+	}
+
+	T* block(std::size_t i, std::size_t j) noexcept {
+		return _data() + (i * tiles_w() + j) * _tile * _tile;
+	}
+
+	const T& at(std::size_t x, std::size_t y) const {
+		if (x >= _rows || y >= _cols)
+			throw std::logic_error("out of bounds");
+		return const_cast< mapped_matrix* >(this)->_ref(x, y);
+	}
+
+	T& at(std::size_t x, std::size_t y) {
+		if (x >= _rows || y >= _cols)
+			throw std::logic_error("out of bounds");
+		return _ref(x, y);
+	}
+
+	matrix< T > load() const {
+		matrix< T > res(_rows, _cols);
+		for (std::size_t x = 0; x < _rows; ++x)
+			for (std::size_t y = 0; y < _cols; ++y)
+				res.at(x, y) = at(x, y);
+		return res;
+	}
+
+	/* page-granular madvise over block (i, j) */
+	void advise(std::size_t i, std::size_t j, int advice) const noexcept {
+		auto page = static_cast< std::uintptr_t >(sysconf(_SC_PAGESIZE));
+		auto begin = reinterpret_cast< std::uintptr_t >(block(i, j));
+		auto end = begin + tile_bytes();
+		begin &= ~(page - 1);
+		madvise(reinterpret_cast< void* >(begin), end - begin, advice);
+	}
+
+private:
+	void _map_file(int prot) {
+		void* p = mmap(nullptr, _bytes, prot, MAP_SHARED, _fd, 0);
+		if (p == MAP_FAILED)
+			throw std::runtime_error("mmap failed");
+		_map = static_cast< char* >(p);
+	}
+
+	T* _data() const noexcept {
+		return reinterpret_cast< T* >(_map + mapped_header::size);
+	}
+
+	T& _ref(std::size_t x, std::size_t y) const noexcept {
+		return _data()[((x / _tile) * tiles_w() + y / _tile) * _tile * _tile + (x % _tile) * _tile + y % _tile];
+	}
+
+	int _fd = -1;
+	char* _map = nullptr;
+	std::size_t _bytes = 0;
+	std::size_t _rows = 0, _cols = 0, _tile = 0;
+};
+
+/* Background thread that faults blocks in ahead of the compute loop:
+ * madvise(WILLNEED) starts the read, touching every page waits for it. */
+class read_ahead {
+public:
+	read_ahead()
+			: _t([this] { _run(); }) {}
+
+	~read_ahead() {
+		{
+			std::lock_guard< std::mutex > g(_m);
+			_stop = true;
+		}
+		_cv.notify_one();
+		_t.join();
+	}
+
+	void push(const void* p, std::size_t bytes) {
+		{
+			std::lock_guard< std::mutex > g(_m);
+			_q.emplace_back(static_cast< const char* >(p), bytes);
+		}
+		_cv.notify_one();
+	}
+
+private:
+	void _run() {
+		auto page = static_cast< std::uintptr_t >(sysconf(_SC_PAGESIZE));
+		while (true) {
+			std::pair< const char*, std::size_t > r;
+			{
+				std::unique_lock< std::mutex > l(_m);
+				_cv.wait(l, [this] { return _stop || !_q.empty(); });
+				if (_stop)
+					return;
+				r = _q.front();
+				_q.pop_front();
+			}
+			auto begin = reinterpret_cast< std::uintptr_t >(r.first) & ~(page - 1);
+			auto end = reinterpret_cast< std::uintptr_t >(r.first) + r.second;
+			madvise(reinterpret_cast< void* >(begin), end - begin, MADV_WILLNEED);
+			for (auto a = begin; a < end; a += page)
+				_sink += *reinterpret_cast< const volatile char* >(a);
+		}
+	}
+
+	std::mutex _m;
+	std::condition_variable _cv;
+	std::deque< std::pair< const char*, std::size_t > > _q;
+	bool _stop = false;
+	char _sink = 0;
+	std::thread _t;
+};
+
+/* c += a * b over files that need not fit in memory. Rows of output blocks
+ * are processed in groups of g block rows and the inner dimension in chunks
+ * of kc blocks; for each block column J the kc blocks of B column J are
+ * streamed past the group's A blocks, while the read-ahead thread faults in
+ * column J + 1. Blocks are released with MADV_DONTNEED once used, so at most
+ *
+ *     g * kc (A) + 2 * kc (B) + g (C)
+ *
+ * blocks are mapped in at a time; g and kc are picked about equal (A is
+ * read once, B once per group and C once per chunk) and within `budget`
+ * bytes, which has to hold at least four blocks. All three operands must
+ * share one tile size; every block product goes through the packed
+ * kernel. */
+template < typename T >
+void out_of_core_mul(const mapped_matrix< T >& a, const mapped_matrix< T >& b, mapped_matrix< T >& c,
+		std::size_t budget = std::size_t(256) << 20) {
+	if (a.width() != b.height() || c.height() != a.height() || c.width() != b.width())
+		throw std::logic_error("dimensions doesn't match");
+	if (a.tile() != b.tile() || a.tile() != c.tile())
+		throw std::logic_error("tile sizes doesn't match");
+
+	std::size_t t = a.tile(), th = a.tiles_h(), tk = a.tiles_w(), tw = b.tiles_w();
+	std::size_t n = budget / a.tile_bytes();
+	if (n < 4)
+		throw std::logic_error("budget smaller than four blocks");
+	/* the largest s with s * s + 3 * s <= n, then whatever one dimension
+	 * cannot use goes to the other */
+	std::size_t s = 1;
+	while ((s + 1) * (s + 1) + 3 * (s + 1) <= n)
+		++s;
+	std::size_t kc = std::min(tk, s);
+	std::size_t g = std::min(th, (n - 2 * kc) / (kc + 1));
+	kc = std::min(tk, (n - g) / (g + 2));
+	const gemm::blocking& bl = block_profile::current().packed;
+	read_ahead ra;
+
+	for (std::size_t i0 = 0; i0 < th; i0 += g) {
+		std::size_t i1 = std::min(th, i0 + g);
+		for (std::size_t k0 = 0; k0 < tk; k0 += kc) {
+			std::size_t k1 = std::min(tk, k0 + kc);
+			auto fetch_b = [&](std::size_t j) {
+				for (std::size_t k = k0; k < k1; ++k)
+					ra.push(b.block(k, j), b.tile_bytes());
+			};
+
+			for (std::size_t i = i0; i < i1; ++i)
+				for (std::size_t k = k0; k < k1; ++k)
+					ra.push(a.block(i, k), a.tile_bytes());
+			fetch_b(0);
+			for (std::size_t j = 0; j < tw; ++j) {
+				if (j + 1 < tw)
+					fetch_b(j + 1);
+				for (std::size_t i = i0; i < i1; ++i) {
+					for (std::size_t k = k0; k < k1; ++k)
+						gemm::multiply(t, t, t, T{ 1 }, a.block(i, k), t, b.block(k, j), t, c.block(i, j), t, bl);
+					c.advise(i, j, MADV_DONTNEED);
+				}
+				for (std::size_t k = k0; k < k1; ++k)
+					b.advise(k, j, MADV_DONTNEED);
+			}
+			for (std::size_t i = i0; i < i1; ++i)
+				for (std::size_t k = k0; k < k1; ++k)
+					a.advise(i, k, MADV_DONTNEED);
+		}
+	}
+}
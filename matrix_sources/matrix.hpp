@@ -8,7 +8,14 @@
 #include <memory>
 #include <future>
 
+#include "aligned_allocator.hpp"
+#include "block_profile.hpp"
+#include "gemm.hpp"
+#include "gemm_wide.hpp"
+#include "thread_pool.hpp"
+
 template < typename T> class matrix;
+template < typename T > class mutable_matrix_view;
 
 template < typename T >
 class matrix_view {
@@ -16,47 +23,142 @@ class matrix_view {
     const T* _data = nullptr;
 
     friend class matrix< T >;
+    friend class mutable_matrix_view< T >;
     T& operator()(std::size_t x, std::size_t y) noexcept {
         return const_cast< T& >(_data[x * w + y]);
     }
+
+    matrix_view(const T* data, std::size_t stride, std::size_t h, std::size_t w)
+            : w(stride),
+              _data(data),
+              width(w),
+              height(h) {}
 public:
     std::size_t width = 0, height = 0;
 
     matrix_view() = default;
 
     matrix_view(const matrix< T >& m, std::size_t start, std::size_t end, std::size_t h, std::size_t w)
-            : w(m.width()),
-              _data(&m.at(start, end)),
+            : w(m.stride()),
+              _data(m.data() + start * m.stride() + end),
               width(w),
               height(h) {}
 
+    matrix_view(const matrix< T >& m)
+            : matrix_view(m, 0, 0, m.height(), m.width()) {}
+
     const T& operator()(std::size_t x, std::size_t y) const noexcept {
         return _data[x * w + y];
     }
 
+    /* h x w block starting at (x, y), sharing the storage of this view */
+    matrix_view sub(std::size_t x, std::size_t y, std::size_t h, std::size_t w) const noexcept {
+        return matrix_view(_data + x * this->w + y, this->w, h, w);
+    }
+
+    const T* data() const noexcept {
+        return _data;
+    }
+
+    std::size_t stride() const noexcept {
+        return w;
+    }
+
+};
+
+/* writable counterpart of matrix_view, the destination of mul_into */
+template < typename T >
+class mutable_matrix_view {
+    std::size_t w = 0;
+    T* _data = nullptr;
+
+    mutable_matrix_view(T* data, std::size_t stride, std::size_t h, std::size_t w)
+            : w(stride),
+              _data(data),
+              width(w),
+              height(h) {}
+public:
+    std::size_t width = 0, height = 0;
+
+    mutable_matrix_view() = default;
+
+    mutable_matrix_view(matrix< T >& m, std::size_t start, std::size_t end, std::size_t h, std::size_t w)
+            : w(m.stride()),
+              _data(m.data() + start * m.stride() + end),
+              width(w),
+              height(h) {}
+
+    mutable_matrix_view(matrix< T >& m)
+            : mutable_matrix_view(m, 0, 0, m.height(), m.width()) {}
+
+    T& operator()(std::size_t x, std::size_t y) const noexcept {
+        return _data[x * w + y];
+    }
+
+    mutable_matrix_view sub(std::size_t x, std::size_t y, std::size_t h, std::size_t w) const noexcept {
+        return mutable_matrix_view(_data + x * this->w + y, this->w, h, w);
+    }
+
+    T* data() const noexcept {
+        return _data;
+    }
+
+    std::size_t stride() const noexcept {
+        return w;
+    }
+
+    operator matrix_view< T >() const noexcept {
+        return matrix_view< T >(_data, w, height, width);
+    }
+
 };
 
 
+/* Rows are `stride()` elements apart. The default leading dimension rounds
+ * the width up to whole 64-byte lines and adds one more line when rows would
+ * otherwise land a multiple of 1 KiB apart, which maps a column walk into
+ * a handful of cache sets (n = 512, 1024, 2048 ...). */
 template < typename T >
 class matrix {
-	std::vector< T > _m;
+	using storage = std::vector< T, aligned_allocator< T > >;
+
+	storage _m;
 	std::size_t _h = 0;
 	std::size_t _w = 0;
+	std::size_t _ld = 0;
 public:
 	matrix() = default;
 
 	matrix(std::size_t height, std::size_t width)
-			: _m(width * height), _h(height), _w(width) {}
+			: matrix(height, width, leading_dimension(width)) {}
 
-    void elems(std::vector< T >&& e) {
-        _m = std::move(e);
-    }
+	matrix(std::size_t height, std::size_t width, std::size_t ld)
+			: _m(ld * height), _h(height), _w(width), _ld(ld) {
+		if (ld < width)
+			throw std::logic_error("leading dimension smaller than width");
+	}
+
+	static std::size_t leading_dimension(std::size_t width) noexcept {
+		constexpr std::size_t line = 64 % sizeof(T) ? 1 : 64 / sizeof(T);
+		std::size_t ld = (width + line - 1) / line * line;
+		if (ld > line && ld * sizeof(T) % 1024 == 0)
+			ld += line;
+		return ld;
+	}
+
+	/* row-major height() x width() elements */
+	void elems(std::vector< T >&& e) {
+		if (e.size() != _h * _w)
+			throw std::logic_error("dimensions doesn't match");
+		for (std::size_t x = 0; x < _h; ++x)
+			std::move(e.begin() + x * _w, e.begin() + (x + 1) * _w, _m.begin() + x * _ld);
+	}
 
 
 	T& at(std::size_t x, std::size_t y) {
 		if (x >= _h || y >= _w)
 			throw std::logic_error("out of bounds");
-		return _m[y + x * _w];
+		return _m[y + x * _ld];
 	}
 
 	const T& at(std::size_t x, std::size_t y) const {
@@ -103,7 +205,7 @@ public:
         res[0] = matrix_view< T >(*this, 0, 0, half_h, half_w);
         res[1] = matrix_view< T >(*this, 0, half_w, half_h, width() - half_w);
         res[2] = matrix_view< T >(*this, half_h, 0, height() - half_h, half_w);
-        res[3] = matrix_view< T >(*this, half_h, half_w, height() - half_w, width() - half_w);
+        res[3] = matrix_view< T >(*this, half_h, half_w, height() - half_h, width() - half_w);
         return res;
     }
 
@@ -120,16 +222,16 @@ public:
             const auto& rm1 = ht[m1],
                         &rm2 = vt[m2];
             auto& rr = rs[r];
-            std::size_t block = 8;
-            for (std::size_t i = 0; i < rm1.height; i += block)
-                for (std::size_t j = 0; j < rr.width; j += block)
-                    for (std::size_t k = 0; k < rm1.width; k += block)
-                        for (std::size_t ix = i; ix < std::min(i + block, rm1.height); ++ix)
-                            for (std::size_t jx = j; jx < std::min(j + block, rr.width); ++jx) {
+            const block_shape block = block_profile::current().cache;
+            for (std::size_t i = 0; i < rm1.height; i += block.m)
+                for (std::size_t j = 0; j < rr.width; j += block.n)
+                    for (std::size_t k = 0; k < rm1.width; k += block.k)
+                        for (std::size_t ix = i; ix < std::min(i + block.m, rm1.height); ++ix)
+                            for (std::size_t jx = j; jx < std::min(j + block.n, rr.width); ++jx) {
                                 T sum{};
-                                for (std::size_t kx = k; kx < std::min(k + block, rm1.width); ++kx)
+                                for (std::size_t kx = k; kx < std::min(k + block.k, rm1.width); ++kx)
                                     sum += rm1(ix, kx) * rm2(kx, jx);
-                                rr(ix, jx) = sum;
+                                rr(ix, jx) += sum;
                             }
         };
 
@@ -137,32 +239,95 @@ public:
         auto f2 = std::async(std::launch::async, f, 1, 0, 2);
         auto f3 = std::async(std::launch::async, f, 0, 1, 1);
         auto f4 = std::async(std::launch::async, f, 1, 1, 3);
-        
+        f1.get(); f2.get(); f3.get(); f4.get();
         return res;
 	}
 
+	/* The result is cut into tiles of about tile_h x tile_w that are spread
+	 * over a persistent work-stealing pool. Every tile is owned by exactly one
+	 * task and summed in the same order, so the result does not depend on
+	 * the number of threads. */
+	matrix parallel_mul(const matrix& m, thread_pool& pool = thread_pool::instance()) const {
+		if (width() != m.height())
+			throw std::logic_error("dimensions doesn't match");
+		std::size_t x = m.width();
+		matrix res(_h, x);
+		constexpr std::size_t mr = gemm::micro< T >::mr;
+		constexpr std::size_t nr = gemm::micro< T >::nr;
+		const gemm::blocking& bl = block_profile::current().packed;
+		std::size_t tile_h = std::max(mr, bl.mc / mr * mr);
+		std::size_t tile_w = 4 * tile_h;
+		/* keep a few tiles per thread around so stealing can balance the load */
+		while (tile_w > nr && _ceil_div(_h, tile_h) * _ceil_div(x, tile_w) < 4 * pool.size())
+			tile_w = std::max(nr, tile_w / 2 / nr * nr);
+		while (tile_h > mr && _ceil_div(_h, tile_h) * _ceil_div(x, tile_w) < 4 * pool.size())
+			tile_h = std::max(mr, tile_h / 2 / mr * mr);
+
+		std::size_t cols = _ceil_div(x, tile_w);
+		pool.parallel_for(_ceil_div(_h, tile_h) * cols, [&](std::size_t t) {
+			std::size_t i = t / cols * tile_h, j = t % cols * tile_w;
+			gemm::multiply(std::min(tile_h, _h - i), std::min(tile_w, x - j), _w, T{ 1 },
+					_m.data() + i * _ld, _ld,
+					m._m.data() + j, m._ld,
+					res._m.data() + i * res._ld + j, res._ld, bl);
+		});
+		return res;
+	}
+
+
+	/* Divide and conquer on matrix_view quadrants, always halving the largest
+	 * of the three dimensions, so every level of the cache hierarchy gets
+	 * blocks that fit. Blocks with all sides under `cutoff` go to the packed
+	 * kernel. The top `strassen_levels` levels of roughly square blocks use
+	 * Strassen-Winograd instead (7 products instead of 8); odd sizes are
+	 * handled by peeling the last row/column. */
+	matrix recursive_mul(const matrix& m, std::size_t cutoff = 64, std::size_t strassen_levels = 0) const {
+		if (width() != m.height())
+			throw std::logic_error("dimensions doesn't match");
+		cutoff = std::max< std::size_t >(cutoff, 2);
+		std::size_t x = m.width();
+		matrix res(_h, x);
+		std::vector< T > arena(_arena_size(_h, x, _w, cutoff, strassen_levels));
+		_recursive(matrix_view< T >(*this, 0, 0, _h, _w),
+				matrix_view< T >(m, 0, 0, m.height(), x),
+				matrix_view< T >(res, 0, 0, _h, x),
+				arena.data(), cutoff, strassen_levels);
+		return res;
+	}
 
 	std::size_t width() const {
 		return _w;
 	}
 
+	/* distance between the starts of two consecutive rows, in elements */
+	std::size_t stride() const noexcept {
+		return _ld;
+	}
+
+	T* data() noexcept {
+		return _m.data();
+	}
+
+	const T* data() const noexcept {
+		return _m.data();
+	}
+
 	std::size_t height() const {
 		return _h;
 	}
 
-	matrix cache_mul(const matrix& m) const {
+	matrix cache_mul(const matrix& m, const block_shape& block = block_profile::current().cache) const {
 		if (width() != m.height())
 			throw std::logic_error("dimensions doesn't match");
 		std::size_t x = m.width();
 		matrix res(_h, x);
-		std::size_t block = 8;
-		for (std::size_t i = 0; i < _h; i += block) {
-			for (std::size_t j = 0; j < x; j += block) {
-				for (std::size_t k = 0; k < _w; k += block) {
-					for (auto ix = i; ix < std::min(i + block, _h); ++ix) {
-						for (auto jx = j; jx < std::min(j + block, x); ++jx) {
+		for (std::size_t i = 0; i < _h; i += block.m) {
+			for (std::size_t j = 0; j < x; j += block.n) {
+				for (std::size_t k = 0; k < _w; k += block.k) {
+					for (auto ix = i; ix < std::min(i + block.m, _h); ++ix) {
+						for (auto jx = j; jx < std::min(j + block.n, x); ++jx) {
 							T sum = T{};
-							for (auto kx = k; kx < std::min(k + block, _w); ++kx) {
+							for (auto kx = k; kx < std::min(k + block.k, _w); ++kx) {
 								sum += _at(ix, kx) * m._at(kx, jx);
 							}
 							res._at(ix, jx) += sum;
@@ -174,24 +339,320 @@ public:
 		return res;
 	}
 
+	/* Out-of-place transpose for any shape. The larger side is halved until
+	 * a block fits in a few cache lines on both sides, so the reads and the
+	 * writes stay in cache at every level without knowing its size. */
+	matrix transpose() const {
+		matrix res(_w, _h);
+		_transpose(_m.data(), _ld, res._m.data(), res._ld, _h, _w);
+		return res;
+	}
+
+	/* in-place transpose of a square matrix: diagonal quadrants recurse,
+	 * off-diagonal ones are swapped with each other while transposed */
+	void transpose_in_place() {
+		if (_h != _w)
+			throw std::logic_error("matrix is not square");
+		_transpose_square(_m.data(), _ld, _h);
+	}
+
+	/* this * bt^T for an already transposed right operand: every entry is a
+	 * dot product of two rows, so both operands are read contiguously */
+	matrix mul_transposed(const matrix& bt) const {
+		if (width() != bt.width())
+			throw std::logic_error("dimensions doesn't match");
+		std::size_t x = bt.height();
+		matrix res(_h, x);
+		for (std::size_t i = 0; i < _h; ++i) {
+			const T* a = &_at(i, 0);
+			for (std::size_t j = 0; j < x; ++j) {
+				const T* b = &bt._at(j, 0);
+				T sum = T{};
+				for (std::size_t k = 0; k < _w; ++k)
+					sum += a[k] * b[k];
+				res._at(i, j) = sum;
+			}
+		}
+		return res;
+	}
+
+	/* A and B are copied into contiguous L1/L2-sized panels and multiplied
+	 * by a register-blocked micro-kernel (AVX2/FMA when the CPU has it) */
+	matrix packed_mul(const matrix& m, const gemm::blocking& bl = block_profile::current().packed) const {
+		if (width() != m.height())
+			throw std::logic_error("dimensions doesn't match");
+		matrix res(_h, m.width());
+		gemm::multiply(_h, m.width(), _w, T{ 1 },
+				_m.data(), _ld,
+				m._m.data(), m._ld,
+				res._m.data(), res._ld, bl);
+		return res;
+	}
+
+	/* packed multiply into the accumulator type picked by gemm::widen,
+	 * e.g. int16 and int32 matrices give an exact int64 result */
+	matrix< typename gemm::widen< T >::type > wide_mul(const matrix& m,
+			const gemm::blocking& bl = block_profile::current().packed) const {
+		if (width() != m.height())
+			throw std::logic_error("dimensions doesn't match");
+		matrix< typename gemm::widen< T >::type > res(_h, m.width());
+		gemm::widen< T >::multiply(_h, m.width(), _w,
+				_m.data(), _ld,
+				m._m.data(), m._ld,
+				res.data(), res.stride(), bl);
+		return res;
+	}
+
 	bool operator==(const matrix& m) const {
 		if (_w != m.width() || _h != m.height())
 			return false;
-		return _m == m._m;
+		for (std::size_t x = 0; x < _h; ++x)
+			if (!std::equal(&_at(x, 0), &_at(x, 0) + _w, &m._at(x, 0)))
+				return false;
+		return true;
 	}
 
 private:
+	using view = matrix_view< T >;
+
+	enum class step { leaf, strassen, split_m, split_n, split_k };
+
+	static step _plan(std::size_t m, std::size_t n, std::size_t k, std::size_t cutoff, std::size_t levels) {
+		std::size_t lo = std::min({ m, n, k }), hi = std::max({ m, n, k });
+		if (hi <= cutoff)
+			return step::leaf;
+		if (levels > 0 && lo >= 2 * cutoff && hi <= 2 * lo)
+			return step::strassen;
+		if (hi == m)
+			return step::split_m;
+		return hi == n ? step::split_n : step::split_k;
+	}
+
+	/* Strassen temporaries are taken from the arena as a stack, so its size
+	 * is the deepest chain of live temporaries */
+	static std::size_t _arena_size(std::size_t m, std::size_t n, std::size_t k, std::size_t cutoff, std::size_t levels) {
+		switch (_plan(m, n, k, cutoff, levels)) {
+		case step::leaf:
+			return 0;
+		case step::strassen:
+			m /= 2; n /= 2; k /= 2;
+			return m * k + k * n + 2 * m * n + _arena_size(m, n, k, cutoff, levels - 1);
+		case step::split_m:
+			return _arena_size(m - m / 2, n, k, cutoff, levels);
+		case step::split_n:
+			return _arena_size(m, n - n / 2, k, cutoff, levels);
+		case step::split_k:
+			return _arena_size(m, n, k - k / 2, cutoff, levels);
+		}
+		return 0;
+	}
+
+	/* c += a * b */
+	static void _recursive(const view& a, const view& b, view c, T* arena, std::size_t cutoff, std::size_t levels) {
+		std::size_t m = a.height, n = b.width, k = a.width;
+		switch (_plan(m, n, k, cutoff, levels)) {
+		case step::leaf:
+			gemm::multiply(m, n, k, T{ 1 }, a._data, a.w, b._data, b.w, &c(0, 0), c.w, block_profile::current().packed);
+			break;
+		case step::strassen:
+			_strassen(a, b, c, arena, cutoff, levels);
+			break;
+		case step::split_m: {
+			std::size_t h = m - m / 2;
+			_recursive(a.sub(0, 0, h, k), b, c.sub(0, 0, h, n), arena, cutoff, levels);
+			_recursive(a.sub(h, 0, m - h, k), b, c.sub(h, 0, m - h, n), arena, cutoff, levels);
+			break;
+		}
+		case step::split_n: {
+			std::size_t w = n - n / 2;
+			_recursive(a, b.sub(0, 0, k, w), c.sub(0, 0, m, w), arena, cutoff, levels);
+			_recursive(a, b.sub(0, w, k, n - w), c.sub(0, w, m, n - w), arena, cutoff, levels);
+			break;
+		}
+		case step::split_k: {
+			std::size_t w = k - k / 2;
+			_recursive(a.sub(0, 0, m, w), b.sub(0, 0, w, n), c, arena, cutoff, levels);
+			_recursive(a.sub(0, w, m, k - w), b.sub(w, 0, k - w, n), c, arena, cutoff, levels);
+			break;
+		}
+		}
+	}
+
+	/* dst = x + sign * y */
+	static void _combine(view dst, const view& x, const view& y, T sign) {
+		for (std::size_t i = 0; i < dst.height; ++i)
+			for (std::size_t j = 0; j < dst.width; ++j)
+				dst(i, j) = x(i, j) + sign * y(i, j);
+	}
+
+	/* dst += sign * x */
+	static void _accumulate(view dst, const view& x, T sign) {
+		for (std::size_t i = 0; i < dst.height; ++i)
+			for (std::size_t j = 0; j < dst.width; ++j)
+				dst(i, j) += sign * x(i, j);
+	}
+
+	/* Strassen-Winograd schedule for c += a * b with four temporaries:
+	 * S (m2 x k2), T (k2 x n2), P and U (m2 x n2) */
+	static void _strassen(const view& a, const view& b, view c, T* arena, std::size_t cutoff, std::size_t levels) {
+		std::size_t m = a.height, n = b.width, k = a.width;
+		std::size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+
+		view a11 = a.sub(0, 0, m2, k2), a12 = a.sub(0, k2, m2, k2),
+		     a21 = a.sub(m2, 0, m2, k2), a22 = a.sub(m2, k2, m2, k2);
+		view b11 = b.sub(0, 0, k2, n2), b12 = b.sub(0, n2, k2, n2),
+		     b21 = b.sub(k2, 0, k2, n2), b22 = b.sub(k2, n2, k2, n2);
+		view c11 = c.sub(0, 0, m2, n2), c12 = c.sub(0, n2, m2, n2),
+		     c21 = c.sub(m2, 0, m2, n2), c22 = c.sub(m2, n2, m2, n2);
+
+		view s(arena, k2, m2, k2);
+		arena += m2 * k2;
+		view t(arena, n2, k2, n2);
+		arena += k2 * n2;
+		view p(arena, n2, m2, n2);
+		arena += m2 * n2;
+		view u(arena, n2, m2, n2);
+		arena += m2 * n2;
+
+		auto product = [&](const view& x, const view& y) {
+			std::fill(&p(0, 0), &p(0, 0) + m2 * n2, T{});
+			_recursive(x, y, p, arena, cutoff, levels - 1);
+		};
+
+		product(a11, b11);                                  // P1
+		_accumulate(c11, p, 1);
+		_combine(u, p, p, 0);                               // U = P1
+		product(a12, b21);                                  // P2
+		_accumulate(c11, p, 1);
+		_combine(s, a21, a22, 1);                           // S1
+		_combine(t, b12, b11, -1);                          // T1
+		product(s, t);                                      // P5
+		_accumulate(c12, p, 1);
+		_accumulate(c22, p, 1);
+		_combine(s, s, a11, -1);                            // S2
+		_combine(t, b22, t, -1);                            // T2
+		product(s, t);                                      // P6
+		_accumulate(u, p, 1);                               // U2 = P1 + P6
+		_accumulate(c12, u, 1);
+		_combine(s, a12, s, -1);                            // S4
+		product(s, b22);                                    // P3
+		_accumulate(c12, p, 1);
+		_combine(t, t, b21, -1);                            // T4
+		product(a22, t);                                    // P4
+		_accumulate(c21, p, -1);
+		_combine(s, a11, a21, -1);                          // S3
+		_combine(t, b22, b12, -1);                          // T3
+		product(s, t);                                      // P7
+		_accumulate(u, p, 1);                               // U3 = U2 + P7
+		_accumulate(c21, u, 1);
+		_accumulate(c22, u, 1);
+
+		/* peel the odd row/column left out of the even-sized core */
+		if (k % 2)
+			gemm::multiply(2 * m2, 2 * n2, 1, T{ 1 }, &a(0, k - 1), a.w, &b(k - 1, 0), b.w, &c(0, 0), c.w);
+		if (n % 2)
+			gemm::multiply(m, 1, k, T{ 1 }, a._data, a.w, &b(0, n - 1), b.w, &c(0, n - 1), c.w);
+		if (m % 2)
+			gemm::multiply(1, 2 * n2, k, T{ 1 }, &a(m - 1, 0), a.w, b._data, b.w, &c(m - 1, 0), c.w);
+	}
+
+	/* blocks up to this many elements per side are transposed directly */
+	static constexpr std::size_t _transpose_leaf = 16;
+
+	/* dst (w x h) = src (h x w)^T */
+	static void _transpose(const T* src, std::size_t lds, T* dst, std::size_t ldd, std::size_t h, std::size_t w) {
+		if (h <= _transpose_leaf && w <= _transpose_leaf) {
+			for (std::size_t i = 0; i < h; ++i)
+				for (std::size_t j = 0; j < w; ++j)
+					dst[j * ldd + i] = src[i * lds + j];
+		} else if (h >= w) {
+			std::size_t half = h / 2;
+			_transpose(src, lds, dst, ldd, half, w);
+			_transpose(src + half * lds, lds, dst + half, ldd, h - half, w);
+		} else {
+			std::size_t half = w / 2;
+			_transpose(src, lds, dst, ldd, h, half);
+			_transpose(src + half, lds, dst + half * ldd, ldd, h, w - half);
+		}
+	}
+
+	/* exchanges the h x w block a with the w x h block b, transposing both */
+	static void _swap_transposed(T* a, T* b, std::size_t ld, std::size_t h, std::size_t w) {
+		using std::swap;
+		if (h <= _transpose_leaf && w <= _transpose_leaf) {
+			for (std::size_t i = 0; i < h; ++i)
+				for (std::size_t j = 0; j < w; ++j)
+					swap(a[i * ld + j], b[j * ld + i]);
+		} else if (h >= w) {
+			std::size_t half = h / 2;
+			_swap_transposed(a, b, ld, half, w);
+			_swap_transposed(a + half * ld, b + half, ld, h - half, w);
+		} else {
+			std::size_t half = w / 2;
+			_swap_transposed(a, b, ld, h, half);
+			_swap_transposed(a + half, b + half * ld, ld, h, w - half);
+		}
+	}
+
+	static void _transpose_square(T* a, std::size_t ld, std::size_t n) {
+		using std::swap;
+		if (n <= _transpose_leaf) {
+			for (std::size_t i = 0; i < n; ++i)
+				for (std::size_t j = i + 1; j < n; ++j)
+					swap(a[i * ld + j], a[j * ld + i]);
+			return;
+		}
+		std::size_t half = n / 2;
+		_transpose_square(a, ld, half);
+		_transpose_square(a + half * ld + half, ld, n - half);
+		_swap_transposed(a + half, a + half * ld, ld, half, n - half);
+	}
+
+	static std::size_t _ceil_div(std::size_t a, std::size_t b) noexcept {
+		return (a + b - 1) / b;
+	}
 
 	T& _at(std::size_t x, std::size_t y) noexcept {
-		return _m[y + x * _w];
+		return _m[y + x * _ld];
 	}
 
 	const T& _at(std::size_t x, std::size_t y) const noexcept {
-		return const_cast< matrix* >(this)->at(x, y);
+		return _m[y + x * _ld];
 	}
 
 };
 
+/* c = alpha * a * b + beta * c, written in place through the views. With
+ * beta == 0 the old contents of c are not read, as in BLAS. Nothing is
+ * allocated once the packing buffers of the calling thread have grown to
+ * the blocking in use. */
+template < typename T >
+void mul_into(const matrix_view< T >& a, const matrix_view< T >& b, mutable_matrix_view< T > c,
+		T alpha = T{ 1 }, T beta = T{},
+		const gemm::blocking& bl = block_profile::current().packed) {
+	if (a.width != b.height || c.height != a.height || c.width != b.width)
+		throw std::logic_error("dimensions doesn't match");
+	if (beta != T{ 1 }) {
+		for (std::size_t x = 0; x < c.height; ++x) {
+			T* row = c.data() + x * c.stride();
+			if (beta == T{})
+				std::fill(row, row + c.width, T{});
+			else
+				for (std::size_t y = 0; y < c.width; ++y)
+					row[y] *= beta;
+		}
+	}
+	gemm::multiply(a.height, b.width, a.width, alpha,
+			a.data(), a.stride(),
+			b.data(), b.stride(),
+			c.data(), c.stride(), bl);
+}
+
+template < typename T >
+void mul_into(const matrix< T >& a, const matrix< T >& b, matrix< T >& c, T alpha = T{ 1 }, T beta = T{}) {
+	mul_into(matrix_view< T >(a), matrix_view< T >(b), mutable_matrix_view< T >(c), alpha, beta);
+}
+
 template < typename T >
 auto generate_random_matrix(std::size_t height, std::size_t width) {
 	std::random_device r;
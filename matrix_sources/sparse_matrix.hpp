@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.hpp"
+#include "thread_pool.hpp"
+
+/* Compressed sparse rows (csr) or columns (csc). For csr, the nonzeros of
+ * row i are values()[ptr()[i] .. ptr()[i + 1]] with their columns in
+ * index(), sorted ascending; csc is the same with rows and columns swapped.
+ * Products take either layout and convert an operand when the kernel needs
+ * the other one. */
+template < typename T >
+class sparse_matrix {
+public:
+	enum class layout { csr, csc };
+
+	sparse_matrix() = default;
+
+	sparse_matrix(std::size_t height, std::size_t width, layout l = layout::csr)
+			: _l(l), _h(height), _w(width), _ptr(_major() + 1, 0) {}
+
+	/* keeps the entries of m that differ from T{} */
+	explicit sparse_matrix(const matrix< T >& m, layout l = layout::csr)
+			: sparse_matrix(m.height(), m.width(), l) {
+		for (std::size_t i = 0; i < _major(); ++i) {
+			for (std::size_t j = 0; j < _minor(); ++j) {
+				const T& v = l == layout::csr ? m.at(i, j) : m.at(j, i);
+				if (v != T{}) {
+					_idx.push_back(j);
+					_val.push_back(v);
+				}
+			}
+			_ptr[i + 1] = _val.size();
+		}
+	}
+
+	/* builds the matrix from unsorted (row, column, value) triplets;
+	 * duplicate positions are summed */
+	static sparse_matrix from_triplets(std::size_t height, std::size_t width,
+			const std::vector< std::size_t >& rows, const std::vector< std::size_t >& cols,
+			const std::vector< T >& vals) {
+		if (rows.size() != cols.size() || rows.size() != vals.size())
+			throw std::logic_error("dimensions doesn't match");
+		sparse_matrix res(height, width);
+		for (std::size_t n = 0; n < rows.size(); ++n) {
+			if (rows[n] >= height || cols[n] >= width)
+				throw std::logic_error("out of bounds");
+			++res._ptr[rows[n] + 1];
+		}
+		std::partial_sum(res._ptr.begin(), res._ptr.end(), res._ptr.begin());
+		res._idx.resize(rows.size());
+		res._val.resize(rows.size());
+		std::vector< std::size_t > next(res._ptr.begin(), res._ptr.end() - 1);
+		for (std::size_t n = 0; n < rows.size(); ++n) {
+			std::size_t at = next[rows[n]]++;
+			res._idx[at] = cols[n];
+			res._val[at] = vals[n];
+		}
+		res._canonicalize();
+		return res;
+	}
+
+	operator matrix< T >() const {
+		matrix< T > res(_h, _w);
+		for (std::size_t i = 0; i < _major(); ++i)
+			for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n)
+				(_l == layout::csr ? res.at(i, _idx[n]) : res.at(_idx[n], i)) = _val[n];
+		return res;
+	}
+
+	std::size_t height() const noexcept {
+		return _h;
+	}
+
+	std::size_t width() const noexcept {
+		return _w;
+	}
+
+	std::size_t nonzeros() const noexcept {
+		return _val.size();
+	}
+
+	layout storage() const noexcept {
+		return _l;
+	}
+
+	const std::vector< std::size_t >& ptr() const noexcept {
+		return _ptr;
+	}
+
+	const std::vector< std::size_t >& index() const noexcept {
+		return _idx;
+	}
+
+	const std::vector< T >& values() const noexcept {
+		return _val;
+	}
+
+	/* value at (x, y), T{} when it is not stored */
+	T at(std::size_t x, std::size_t y) const {
+		if (x >= _h || y >= _w)
+			throw std::logic_error("out of bounds");
+		std::size_t i = _l == layout::csr ? x : y, j = _l == layout::csr ? y : x;
+		auto begin = _idx.begin() + _ptr[i], end = _idx.begin() + _ptr[i + 1];
+		auto it = std::lower_bound(begin, end, j);
+		return it != end && *it == j ? _val[it - _idx.begin()] : T{};
+	}
+
+	/* the same matrix stored in the other layout, by a counting sort */
+	sparse_matrix converted(layout l) const {
+		if (l == _l)
+			return *this;
+		sparse_matrix res(_h, _w, l);
+		for (std::size_t j : _idx)
+			++res._ptr[j + 1];
+		std::partial_sum(res._ptr.begin(), res._ptr.end(), res._ptr.begin());
+		res._idx.resize(_idx.size());
+		res._val.resize(_val.size());
+		std::vector< std::size_t > next(res._ptr.begin(), res._ptr.end() - 1);
+		for (std::size_t i = 0; i < _major(); ++i) {
+			for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n) {
+				std::size_t at = next[_idx[n]]++;
+				res._idx[at] = i;
+				res._val[at] = _val[n];
+			}
+		}
+		return res;
+	}
+
+	/* y = this * x */
+	std::vector< T > mul_vector(const std::vector< T >& x) const {
+		if (x.size() != _w)
+			throw std::logic_error("dimensions doesn't match");
+		std::vector< T > y(_h);
+		if (_l == layout::csr) {
+			for (std::size_t i = 0; i < _h; ++i) {
+				T sum = T{};
+				for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n)
+					sum += _val[n] * x[_idx[n]];
+				y[i] = sum;
+			}
+		} else {
+			for (std::size_t j = 0; j < _w; ++j)
+				for (std::size_t n = _ptr[j]; n < _ptr[j + 1]; ++n)
+					y[_idx[n]] += _val[n] * x[j];
+		}
+		return y;
+	}
+
+	/* this * m; row i of the result is the sum of the rows of m picked by
+	 * the nonzeros of row i, rows split over the pool */
+	matrix< T > mul_dense(const matrix< T >& m, thread_pool& pool = thread_pool::instance()) const {
+		if (_w != m.height())
+			throw std::logic_error("dimensions doesn't match");
+		if (_l != layout::csr)
+			return converted(layout::csr).mul_dense(m, pool);
+		matrix< T > res(_h, m.width());
+		std::size_t x = m.width();
+		std::size_t per_task = _rows_per_task(pool);
+		pool.parallel_for((_h + per_task - 1) / per_task, [&](std::size_t t) {
+			for (std::size_t i = t * per_task; i < std::min(_h, (t + 1) * per_task); ++i) {
+				T* out = res.data() + i * res.stride();
+				for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n) {
+					const T v = _val[n];
+					const T* row = m.data() + _idx[n] * m.stride();
+					for (std::size_t j = 0; j < x; ++j)
+						out[j] += v * row[j];
+				}
+			}
+		});
+		return res;
+	}
+
+	/* Gustavson: row i of the result is accumulated in a dense scratch row
+	 * from the rows of m picked by row i of this, remembering which columns
+	 * were touched. A symbolic pass counts the nonzeros of every row so the
+	 * numeric pass can write straight into the final arrays; both passes
+	 * split the rows over the pool, each task with its own scratch. */
+	sparse_matrix mul_sparse(const sparse_matrix& m, thread_pool& pool = thread_pool::instance()) const {
+		if (_w != m._h)
+			throw std::logic_error("dimensions doesn't match");
+		if (_l != layout::csr)
+			return converted(layout::csr).mul_sparse(m, pool);
+		if (m._l != layout::csr)
+			return mul_sparse(m.converted(layout::csr), pool);
+
+		sparse_matrix res(_h, m._w);
+		std::size_t per_task = _rows_per_task(pool);
+		std::size_t tasks = (_h + per_task - 1) / per_task;
+		constexpr std::size_t none = std::size_t(-1);
+
+		pool.parallel_for(tasks, [&](std::size_t t) {
+			std::vector< std::size_t > mark(m._w, none);
+			for (std::size_t i = t * per_task; i < std::min(_h, (t + 1) * per_task); ++i) {
+				std::size_t count = 0;
+				for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n)
+					for (std::size_t q = m._ptr[_idx[n]]; q < m._ptr[_idx[n] + 1]; ++q)
+						if (mark[m._idx[q]] != i) {
+							mark[m._idx[q]] = i;
+							++count;
+						}
+				res._ptr[i + 1] = count;
+			}
+		});
+		std::partial_sum(res._ptr.begin(), res._ptr.end(), res._ptr.begin());
+		res._idx.resize(res._ptr.back());
+		res._val.resize(res._ptr.back());
+
+		pool.parallel_for(tasks, [&](std::size_t t) {
+			std::vector< T > acc(m._w);
+			std::vector< std::size_t > mark(m._w, none);
+			for (std::size_t i = t * per_task; i < std::min(_h, (t + 1) * per_task); ++i) {
+				std::size_t* cols = res._idx.data() + res._ptr[i];
+				std::size_t count = 0;
+				for (std::size_t n = _ptr[i]; n < _ptr[i + 1]; ++n) {
+					const T v = _val[n];
+					for (std::size_t q = m._ptr[_idx[n]]; q < m._ptr[_idx[n] + 1]; ++q) {
+						std::size_t j = m._idx[q];
+						if (mark[j] != i) {
+							mark[j] = i;
+							acc[j] = T{};
+							cols[count++] = j;
+						}
+						acc[j] += v * m._val[q];
+					}
+				}
+				std::sort(cols, cols + count);
+				for (std::size_t c = 0; c < count; ++c)
+					res._val[res._ptr[i] + c] = acc[cols[c]];
+			}
+		});
+		return res;
+	}
+
+private:
+	std::size_t _major() const noexcept {
+		return _l == layout::csr ? _h : _w;
+	}
+
+	std::size_t _minor() const noexcept {
+		return _l == layout::csr ? _w : _h;
+	}
+
+	/* enough rows per task to amortize the scratch row, a few tasks per thread */
+	std::size_t _rows_per_task(const thread_pool& pool) const noexcept {
+		return std::max< std::size_t >(16, _h / (4 * pool.size()) + 1);
+	}
+
+	/* sorts every row by index and sums duplicates */
+	void _canonicalize() {
+		std::vector< std::pair< std::size_t, T > > row;
+		std::size_t out = 0, begin = 0;
+		for (std::size_t i = 0; i < _major(); ++i) {
+			row.clear();
+			for (std::size_t n = begin; n < _ptr[i + 1]; ++n)
+				row.emplace_back(_idx[n], _val[n]);
+			std::sort(row.begin(), row.end(),
+					[](const auto& a, const auto& b) { return a.first < b.first; });
+			begin = _ptr[i + 1];
+			_ptr[i] = out;
+			for (std::size_t n = 0; n < row.size(); ++n) {
+				if (out > _ptr[i] && _idx[out - 1] == row[n].first) {
+					_val[out - 1] += row[n].second;
+				} else {
+					_idx[out] = row[n].first;
+					_val[out] = row[n].second;
+					++out;
+				}
+			}
+		}
+		_ptr[_major()] = out;
+		_idx.resize(out);
+		_val.resize(out);
+	}
+
+	layout _l = layout::csr;
+	std::size_t _h = 0, _w = 0;
+	std::vector< std::size_t > _ptr{ 0 };
+	std::vector< std::size_t > _idx;
+	std::vector< T > _val;
+};
+
+/* every entry is nonzero with probability `density`; the gaps between
+ * nonzeros are drawn from a geometric distribution, so the cost is
+ * proportional to the number of nonzeros and not to height * width */
+template < typename T >
+auto generate_random_sparse_matrix(std::size_t height, std::size_t width, double density) {
+	std::random_device r;
+	std::mt19937 e(r());
+	auto m = std::make_unique< sparse_matrix< T > >(height, width);
+	std::vector< std::size_t > rows, cols;
+	std::vector< T > vals;
+	if (density > 0) {
+		std::geometric_distribution< std::size_t > gap(std::min(density, 1.0));
+		for (std::size_t at = gap(e); at < height * width; at += 1 + gap(e)) {
+			short v = static_cast< short >(e());
+			rows.push_back(at / width);
+			cols.push_back(at % width);
+			vals.push_back(v ? v : 1);
+		}
+	}
+	*m = sparse_matrix< T >::from_triplets(height, width, rows, cols, vals);
+	return m;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Persistent work-stealing pool. Every worker owns a deque: it pops its own
+ * tasks from the back and steals from the front of the others. The thread
+ * calling parallel_for takes part in the work, so a pool of size n runs
+ * n - 1 background workers. */
+class thread_pool {
+	using task = std::function< void() >;
+
+	struct queue {
+		std::mutex m;
+		std::deque< task > tasks;
+	};
+
+public:
+	explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency()) {
+		std::size_t workers = threads > 1 ? threads - 1 : 0;
+		for (std::size_t i = 0; i < workers; ++i)
+			_queues.push_back(std::make_unique< queue >());
+		for (std::size_t i = 0; i < workers; ++i)
+			_threads.emplace_back([this, i] { _work(i); });
+	}
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	~thread_pool() {
+		{
+			std::lock_guard< std::mutex > g(_m);
+			_stop = true;
+		}
+		_cv.notify_all();
+		for (auto& t : _threads)
+			t.join();
+	}
+
+	static thread_pool& instance() {
+		static thread_pool pool;
+		return pool;
+	}
+
+	/* number of threads taking part in parallel_for, the caller included */
+	std::size_t size() const noexcept {
+		return _threads.size() + 1;
+	}
+
+	/* runs f(0) ... f(count - 1) and returns once all of them finished;
+	 * the first exception thrown by a task is rethrown here */
+	template < typename F >
+	void parallel_for(std::size_t count, F&& f) {
+		struct job {
+			std::atomic< std::size_t > left;
+			std::mutex m;
+			std::exception_ptr error;
+		} j;
+		j.left = count;
+
+		for (std::size_t i = 0; i < count; ++i) {
+			_push([&j, &f, i] {
+				try {
+					f(i);
+				} catch (...) {
+					std::lock_guard< std::mutex > g(j.m);
+					if (!j.error)
+						j.error = std::current_exception();
+				}
+				j.left.fetch_sub(1, std::memory_order_release);
+			}, i);
+		}
+		_cv.notify_all();
+
+		std::size_t self = _self_pool == this ? _self : _queues.size();
+		while (j.left.load(std::memory_order_acquire) != 0) {
+			if (!_run_one(self))
+				std::this_thread::yield();
+		}
+		if (j.error)
+			std::rethrow_exception(j.error);
+	}
+
+private:
+	void _push(task&& t, std::size_t hint) {
+		if (_queues.empty()) {
+			/* no workers: the caller drains its own job */
+			std::lock_guard< std::mutex > g(_m);
+			_local.push_back(std::move(t));
+			++_queued;
+			return;
+		}
+		{
+			std::lock_guard< std::mutex > g(_m);
+			++_queued;
+		}
+		auto& q = *_queues[hint % _queues.size()];
+		std::lock_guard< std::mutex > g(q.m);
+		q.tasks.push_back(std::move(t));
+	}
+
+	bool _take(queue& q, bool own, task& t) {
+		std::lock_guard< std::mutex > g(q.m);
+		if (q.tasks.empty())
+			return false;
+		if (own) {
+			t = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		} else {
+			t = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+		return true;
+	}
+
+	bool _run_one(std::size_t self) {
+		task t;
+		std::size_t n = _queues.size();
+		bool found = self < n && _take(*_queues[self], true, t);
+		for (std::size_t i = 1; !found && i <= n; ++i)
+			found = _take(*_queues[(self + i) % n], false, t);
+		if (!found && n == 0) {
+			std::lock_guard< std::mutex > g(_m);
+			if (!_local.empty()) {
+				t = std::move(_local.front());
+				_local.pop_front();
+				found = true;
+			}
+		}
+		if (!found)
+			return false;
+		_queued.fetch_sub(1, std::memory_order_relaxed);
+		t();
+		return true;
+	}
+
+	void _work(std::size_t self) {
+		_self_pool = this;
+		_self = self;
+		while (true) {
+			if (_run_one(self))
+				continue;
+			std::unique_lock< std::mutex > l(_m);
+			_cv.wait(l, [this] { return _stop || _queued.load() != 0; });
+			if (_stop)
+				return;
+		}
+	}
+
+	std::vector< std::unique_ptr< queue > > _queues;
+	std::vector< std::thread > _threads;
+	std::deque< task > _local;
+	std::mutex _m;
+	std::condition_variable _cv;
+	std::atomic< std::size_t > _queued{ 0 };
+	bool _stop = false;
+
+	inline static thread_local thread_pool* _self_pool = nullptr;
+	inline static thread_local std::size_t _self = 0;
+};